@@ -0,0 +1,321 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/uaccess.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/rcupdate.h>
+#include "device.h"
+#include "injection.h"
+#include "kinjector.h"
+#include "execute.h"
+
+/* --- CONVERSION ---------------------------------------------------------- */
+/*
+ * Copy a name from ioctl structure. Empty name is left as NULL.
+ * Returns true on success.
+ */
+static bool ki_device_name(const char *name, size_t len, char **result,
+                           char **msg)
+{
+        if (!strnlen(name, len)) return true;
+        if (strnlen(name, len) == len) {
+                *msg = "Name is not terminated";
+                return false;
+        }
+
+        *result = kstrdup(name, GFP_KERNEL);
+        if (!*result) {
+                *msg = "Out of memory";
+                return false;
+        }
+        return true;
+}
+
+/*
+ * Fill kernel injection from ioctl structure. Checks done by the parser are
+ * repeated here, the rest is left to ki_validate_injection.
+ * Returns true on success.
+ */
+static bool ki_device_convert(struct ki_ioc_injection *ioc,
+                              struct ki_injection *injection, char **msg)
+{
+        if (ioc->flags & ~(KI_FLG_OUTCOME * 2 - 1)) {
+                *msg = "Unknown flags";
+                return false;
+        }
+        if (ioc->trigger_mode > KI_TRIG_FTRACE) {
+                *msg = "Unknown TRIGGER_MODE";
+                return false;
+        }
+        if (ioc->fault > KI_FAULT_RANDOM) {
+                *msg = "Unknown FAULT";
+                return false;
+        }
+        if (ioc->sched > KI_SCHED_POISSON) {
+                *msg = "Unknown scheduling policy";
+                return false;
+        }
+        if (ioc->bitflip < 0) {
+                *msg = "Wrong BITFLIP argument";
+                return false;
+        }
+        if ((ioc->fault == KI_FAULT_BITS || ioc->fault == KI_FAULT_BURST) &&
+            (ioc->fault_arg < 1 || ioc->fault_arg > 64)) {
+                *msg = "Wrong FAULT number of bits";
+                return false;
+        }
+        if (ioc->fault >= KI_FAULT_XOR && ioc->fault <= KI_FAULT_STUCK1 &&
+            !ioc->fault_arg) {
+                *msg = "Wrong FAULT mask";
+                return false;
+        }
+
+        if (!ki_device_name(ioc->target.name, sizeof(ioc->target.name),
+                            &injection->target.name, msg) ||
+            !ki_device_name(ioc->trigger.name, sizeof(ioc->trigger.name),
+                            &injection->trigger.name, msg) ||
+            !ki_device_name(ioc->module, sizeof(ioc->module),
+                            &injection->module_name, msg))
+                return false;
+
+        if (!injection->target.name)
+                injection->target.addr = ioc->target.addr;
+        if (!injection->trigger.name)
+                injection->trigger.addr = ioc->trigger.addr;
+        injection->target_offset  = ioc->target_offset;
+        injection->trigger_offset = ioc->trigger_offset;
+        injection->trigger_mode   = ioc->trigger_mode;
+        injection->timer_period   = ioc->timer_period;
+        injection->timer_jitter   = ioc->timer_jitter;
+        injection->bitflip        = ioc->bitflip;
+        injection->fault          = ioc->fault;
+        injection->fault_arg      = ioc->fault_arg;
+        injection->max_inj        = ioc->max_inj;
+        injection->skipped_inj    = ioc->skipped_inj;
+        injection->sched          = ioc->sched;
+        injection->sched_arg      = ioc->sched_arg;
+        injection->debug          = ioc->debug;
+        injection->seed           = ioc->seed;
+        injection->flags          = ioc->flags;
+        injection->ref_id         = ioc->ref_id;
+        injection->campaign       = ioc->campaign;
+        injection->interval       = ioc->interval;
+        injection->duration       = ioc->duration;
+        injection->profile        = ioc->profile;
+
+        *msg = "OK";
+        return true;
+}
+
+/* --- IOCTL --------------------------------------------------------------- */
+/*
+ * Submit an array of injections as one batch and copy back their results
+ */
+static long ki_device_submit(struct ki_ioc_submit __user *arg)
+{
+        size_t i;
+        long ret = 0;
+        struct ki_ioc_submit submit;
+        struct ki_ioc_injection *ioc;
+        struct ki_ioc_result result;
+        struct ki_ioc_injection __user *uinjections;
+        struct ki_ioc_result __user *uresults;
+        struct ki_injection **injections;
+        struct ki_status *status;
+
+        if (copy_from_user(&submit, arg, sizeof(submit))) return -EFAULT;
+        if (submit.version != KI_IOC_VERSION || 
+            submit.size != sizeof(*ioc)) 
+                return -EPROTO;
+        if (!submit.count || submit.count > KI_IOC_MAX_COUNT) return -EINVAL;
+
+        uinjections = (void __user *)(unsigned long)submit.injections;
+        uresults = (void __user *)(unsigned long)submit.results;
+
+        ioc = kmalloc(sizeof(*ioc), GFP_KERNEL);
+        injections = kcalloc(submit.count, sizeof(*injections), GFP_KERNEL);
+        status = kcalloc(submit.count, sizeof(*status), GFP_KERNEL);
+        if (!ioc || !injections || !status) {
+                ret = -ENOMEM;
+                goto out;
+        }
+
+        /* Convert all injections, failed ones are left as NULL */
+        for (i = 0; i < submit.count; ++i) {
+                struct ki_injection *injection;
+
+                if (copy_from_user(ioc, uinjections + i, sizeof(*ioc))) {
+                        ret = -EFAULT;
+                        goto out;
+                }
+
+                injection = kmalloc(sizeof(*injection), GFP_KERNEL);
+                if (!injection) {
+                        status[i].msg = "Out of memory";
+                        continue;
+                }
+                ki_init_injection(injection);
+
+                if (!ki_device_convert(ioc, injection, &status[i].msg)) {
+                        ki_free_injection(injection);
+                        continue;
+                }
+                injections[i] = injection;
+        }
+
+        /* Validate and execute, batch takes care of injections */
+        ki_registry_execute(injections, submit.count, status);
+
+        /* Executor marks successful commands, others carry an error */
+        submit.failed = 0;
+        for (i = 0; i < submit.count; ++i) {
+                memset(&result, 0, sizeof(result));
+                result.id = status[i].id;
+                result.error = status[i].ok ? 0 : -EINVAL;
+                strlcpy(result.msg, status[i].msg, sizeof(result.msg));
+                if (result.error) ++submit.failed;
+
+                if (copy_to_user(uresults + i, &result, sizeof(result)))
+                        ret = -EFAULT;
+        }
+        if (copy_to_user(&arg->failed, &submit.failed, sizeof(submit.failed)))
+                ret = -EFAULT;
+
+out:
+        /* Injections are left only if the batch wasn't executed */
+        if (injections)
+                for (i = 0; i < submit.count; ++i)
+                        if (injections[i]) ki_free_injection(injections[i]);
+        kfree(status);
+        kfree(injections);
+        kfree(ioc);
+        return ret;
+}
+
+/*
+ * Read counters of injections. Every element is looked up by its id.
+ */
+static long ki_device_counters(struct ki_ioc_query __user *arg)
+{
+        size_t i;
+        struct ki_ioc_query query;
+        struct ki_ioc_counters counters;
+        struct ki_ioc_counters __user *ucounters;
+
+        if (copy_from_user(&query, arg, sizeof(query))) return -EFAULT;
+        if (query.version != KI_IOC_VERSION || 
+            query.size != sizeof(counters)) 
+                return -EPROTO;
+        if (!query.count || query.count > KI_IOC_MAX_COUNT) return -EINVAL;
+
+        ucounters = (void __user *)(unsigned long)query.counters;
+        query.found = 0;
+
+        for (i = 0; i < query.count; ++i) {
+                struct ki_injection *injection;
+                long returned, errors;
+                u64 latency;
+                int id;
+
+                if (get_user(id, &ucounters[i].id)) return -EFAULT;
+                memset(&counters, 0, sizeof(counters));
+                counters.id = id;
+
+                /* Counters are sampled without stopping the injection */
+                rcu_read_lock();
+                injection = id > 0 ? ki_registry_find(id) : NULL;
+                if (injection) {
+                        counters.state = ACCESS_ONCE(injection->finished) ?
+                                         KI_IOC_STATE_FINISHED :
+                                         KI_IOC_STATE_ARMED;
+                        counters.calls = ki_injection_calls(injection);
+                        counters.max = injection->campaign ?
+                                       injection->campaign :
+                                       injection->max_inj;
+                        if (injection->flags & KI_FLG_OUTCOME) {
+                                ki_injection_outcome(injection, &returned,
+                                                     &errors, &latency);
+                                counters.returned = returned;
+                                counters.errors = errors;
+                                counters.latency = latency;
+                        }
+                        ++query.found;
+                }
+                rcu_read_unlock();
+
+                if (copy_to_user(ucounters + i, &counters, sizeof(counters)))
+                        return -EFAULT;
+        }
+
+        if (copy_to_user(&arg->found, &query.found, sizeof(query.found)))
+                return -EFAULT;
+        return 0;
+}
+
+/*
+ * Dispatch ioctl commands. Structures have the same layout on 32 and 64
+ * bit, so compat calls are handled here as well.
+ */
+static long ki_device_ioctl(struct file *file, unsigned int cmd,
+                            unsigned long arg)
+{
+        switch (cmd) {
+        case KI_IOC_SUBMIT:
+                return ki_device_submit((void __user *)arg);
+        case KI_IOC_COUNTERS:
+                return ki_device_counters((void __user *)arg);
+        default:
+                return -ENOTTY;
+        }
+}
+
+static const struct file_operations ki_device_ops = {
+        .owner          = THIS_MODULE,
+        .unlocked_ioctl = ki_device_ioctl,
+        .compat_ioctl   = ki_device_ioctl,
+        .llseek         = noop_llseek
+};
+
+static struct miscdevice ki_device = {
+        .minor = MISC_DYNAMIC_MINOR,
+        .name  = MODULE_NAME_STR,
+        .fops  = &ki_device_ops,
+        .mode  = 0600
+};
+
+/* --- DEVICE -------------------------------------------------------------- */
+/*
+ * Register /dev/kernelinjector
+ * Returns 0 on success.
+ */
+int ki_device_init(void)
+{
+        return misc_register(&ki_device);
+}
+
+/*
+ * Unregister /dev/kernelinjector, running ioctls keep the module alive
+ */
+void ki_device_exit(void)
+{
+        misc_deregister(&ki_device);
+}
@@ -0,0 +1,152 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_DEVICE_H
+#define KI_DEVICE_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* --- IOCTL STRUCTURES ---------------------------------------------------- */
+/*
+ * Binary control interface of /dev/kernelinjector. Every request carries
+ * KI_IOC_VERSION and size of its array elements, requests of other versions
+ * are rejected with EPROTO. Values and flags have the same meaning as
+ * fields of struct ki_injection and enums of injection.h. REPLAY entries
+ * can be passed only through procfs.
+ */
+#define KI_IOC_VERSION   1
+#define KI_IOC_NAME_LEN  128    /* Symbol name including terminating zero */
+#define KI_IOC_MODULE_LEN 56    /* Module name including terminating zero */
+#define KI_IOC_MSG_LEN   64     /* Result message including terminating zero */
+#define KI_IOC_MAX_COUNT 1024   /* Elements of one request */
+
+/*
+ * Injection symbol. Name is looked up when it's not empty, otherwise
+ * address is used as is.
+ */
+struct ki_ioc_symbol
+{
+        __u64 addr;
+        char  name[KI_IOC_NAME_LEN];
+};
+
+/*
+ * One injection, the same as one command line written to procfs
+ */
+struct ki_ioc_injection
+{
+        struct ki_ioc_symbol target;    /* INJECT_INTO */
+        struct ki_ioc_symbol trigger;   /* TRIGGER */
+        char  module[KI_IOC_MODULE_LEN]; /* MODULE, empty if none */
+        __s64 target_offset;            /* INJECT_OFFSET */
+        __s64 trigger_offset;           /* TRIGGER_OFFSET */
+        __s64 timer_period;             /* TRIGGER_TIMER in ns */
+        __s64 timer_jitter;             /* TIMER_JITTER in ns */
+        __s64 bitflip;                  /* BITFLIP bytes */
+        __u64 fault_arg;                /* FAULT number of bits or mask */
+        __s64 max_inj;                  /* MAX_INJECTIONS */
+        __s64 skipped_inj;              /* SKIPPED_INJECTIONS */
+        __u64 sched_arg;                /* Probability * 2^32, stride, mean */
+        __s64 seed;                     /* SEED */
+        __s64 ref_id;                   /* REMOVE or SHOW id */
+        __s64 campaign;                 /* CAMPAIGN injections */
+        __s64 interval;                 /* INTERVAL in us */
+        __s64 duration;                 /* DURATION in ms */
+        __s64 profile;                  /* PROFILE in ms */
+        __u32 flags;                    /* enum ki_flags_e */
+        __u32 trigger_mode;             /* enum ki_trigger_mode_e */
+        __u32 fault;                    /* enum ki_fault_e */
+        __u32 sched;                    /* enum ki_sched_e */
+        __u32 debug;                    /* DEBUG */
+        __u32 pad;
+};
+
+/*
+ * Result of one submitted injection
+ */
+struct ki_ioc_result
+{
+        __s32 error;                    /* 0 or negative errno */
+        __s32 id;                       /* Id of armed injection, 0 if none */
+        char  msg[KI_IOC_MSG_LEN];      /* Same as procfs status line */
+};
+
+/*
+ * KI_IOC_SUBMIT argument. Injections are executed as one batch, ATOMIC
+ * flag of any of them makes the whole batch atomic.
+ */
+struct ki_ioc_submit
+{
+        __u32 version;                  /* KI_IOC_VERSION */
+        __u32 size;                     /* sizeof(struct ki_ioc_injection) */
+        __u32 count;                    /* Number of injections */
+        __u32 failed;                   /* Out: number of failed injections */
+        __u64 injections;               /* struct ki_ioc_injection array */
+        __u64 results;                  /* struct ki_ioc_result array */
+};
+
+/*
+ * Injection states reported by KI_IOC_COUNTERS
+ */
+enum ki_ioc_state_e
+{
+        KI_IOC_STATE_NONE     = 0,      /* No injection with the id */
+        KI_IOC_STATE_ARMED    = 1,      /* Trigger, timer or thread running */
+        KI_IOC_STATE_FINISHED = 2       /* Campaign or profile is done */
+};
+
+/*
+ * Counters of one injection, the same as its procfs listing line
+ */
+struct ki_ioc_counters
+{
+        __s32 id;                       /* In: injection id */
+        __u32 state;                    /* enum ki_ioc_state_e */
+        __s64 calls;                    /* Injections, or PROFILE samples */
+        __s64 max;                      /* MAX_INJECTIONS or CAMPAIGN */
+        __s64 returned;                 /* OUTCOME returned calls */
+        __s64 errors;                   /* OUTCOME negative return values */
+        __u64 latency;                  /* OUTCOME sum of latencies in ns */
+};
+
+/*
+ * KI_IOC_COUNTERS argument
+ */
+struct ki_ioc_query
+{
+        __u32 version;                  /* KI_IOC_VERSION */
+        __u32 size;                     /* sizeof(struct ki_ioc_counters) */
+        __u32 count;                    /* Number of counters */
+        __u32 found;                    /* Out: number of existing ids */
+        __u64 counters;                 /* struct ki_ioc_counters array */
+};
+
+#define KI_IOC_MAGIC    'k'
+#define KI_IOC_SUBMIT   _IOWR(KI_IOC_MAGIC, 1, struct ki_ioc_submit)
+#define KI_IOC_COUNTERS _IOWR(KI_IOC_MAGIC, 2, struct ki_ioc_query)
+
+#ifdef __KERNEL__
+
+/* --- DEVICE FUNCTIONS ---------------------------------------------------- */
+int ki_device_init(void);
+void ki_device_exit(void);
+
+#endif /*__KERNEL__*/
+
+#endif /*KI_DEVICE_H*/
@@ -16,93 +16,197 @@
     along with this program.  If not, see [http://www.gnu.org/licenses/].
 -----------------------------------------------------------------------------*/
 #include <linux/kprobes.h>
-#include <linux/random.h>
+#include <linux/ftrace.h>
 #include <linux/module.h>
 #include <linux/stddef.h>
+#include <linux/percpu.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
+#include <linux/jiffies.h>
+#include <linux/bitops.h>
+#include <linux/sort.h>
 #include "execute.h"
 #include "injection.h"
 #include "kinjector.h"
+#include "records.h"
+#include "probe.h"
+#include "poke.h"
+#include "segment.h"
+#include "profile.h"
+#include "trace.h"
+#include "stats.h"
+#include "schedule.h"
 
 /* --- DEFINES ------------------------------------------------------------ */
 #define IS_REG(byte, reg, name) \
     if ((byte) >= offsetof(struct pt_regs, reg) && \
         (byte) < offsetof(struct pt_regs, reg) + reg_size) reg_name = name
 
+#define KI_LOG(...) \
+    do { if (ki_syslog) printk(MODULE_PRINTK_ERR __VA_ARGS__); } while (0)
+
+/* --- SEGMENT TARGETS ---------------------------------------------------- */
+/*
+ * Segment injected by a flag
+ */
+struct ki_seg_target
+{
+        enum ki_flags_e        flag;
+        enum ki_seg_e          seg;
+        enum ki_record_type_e  type;
+        const char            *name;
+};
+
+static const struct ki_seg_target ki_seg_targets[] = {
+        { KI_FLG_DATA,   KI_SEG_DATA,   KI_REC_DATA,   "DATA"   },
+        { KI_FLG_RODATA, KI_SEG_RODATA, KI_REC_RODATA, "RODATA" },
+        { KI_FLG_CODE,   KI_SEG_TEXT,   KI_REC_CODE,   "CODE"   },
+        { KI_FLG_BSS,    KI_SEG_BSS,    KI_REC_BSS,    "BSS"    },
+        { KI_FLG_INIT,   KI_SEG_INIT,   KI_REC_INIT,   "INIT"   },
+        { KI_FLG_PERCPU, KI_SEG_PERCPU, KI_REC_PERCPU, "PERCPU" }
+};
+
+
 /* --- FUNCTIONS ---------------------------------------------------------- */
 /*
- * Invert specific bit under an address
+ * Describe modification of a word under an address and add it to the
+ * injection's writes. Bits of clear mask are cleared, bits of set mask are
+ * set and then bits of flip mask are inverted. Word is recorded with its
+ * offset from base, the start of place of given type, only if it's going
+ * to be written.
  */
-static void ki_bitflip(unsigned long addr, unsigned char bit,
-                       struct ki_injection *injection)
+static void ki_fault_word(unsigned long addr, unsigned int size,
+                          u64 clear, u64 set, u64 flip,
+                          struct ki_injection *injection, struct ki_poke *poke,
+                          enum ki_record_type_e type, unsigned long base)
 {
-        bool rw;
-        char byte;
-        unsigned int level;
-        pte_t *pte;
+        u64 old, new;
 
-        rw = true;
-        pte = lookup_address(addr, &level);
-        if (!(pte->pte & _PAGE_RW)) {
-                pte->pte |= _PAGE_RW;
-                rw = false;
-        }
-        
-        printk(MODULE_PRINTK_ERR "\tBITFLIP 0x%lx:%d (%pF)\n", addr, bit, 
-               (void*)addr);
+        old = ki_word_read(addr, size);
+        new = ((old & ~clear) | set) ^ flip;
 
-        if (!injection->debug) {
-            byte = *(char*)(addr);
-            byte ^= 1 << bit;
-            *(char*)(addr) = byte;
+        /* Word which won't be written is not recorded */
+        if (!injection->debug &&
+            !ki_poke_add(poke, addr, size, clear, set, flip)) {
+                KI_LOG("\tDROPPED 0x%lx:%u (%pF)\n", addr, size, (void*)addr);
+                return;
         }
 
-        if (!rw) pte->pte &= ~_PAGE_RW;
+        ki_record(injection, type, addr, size, old ^ new,
+                  type == KI_REC_REGS ? addr - base : 0,
+                  this_cpu_ptr(injection->pcpu)->hit, addr - base);
+        trace_ki_flip(injection, type, addr, size, old ^ new);
+        if (injection->fault == KI_FAULT_BITFLIP)
+                KI_LOG("\tBITFLIP 0x%lx:%d (%pF)\n", addr, (int)__ffs64(flip),
+                       (void*)addr);
+        else
+                KI_LOG("\tFAULT 0x%lx:%u 0x%llx>0x%llx (%pF)\n", addr, size,
+                       old, new, (void*)addr);
 }
 
 /*
- * Invert one bit in a sequence of count bytes starting under addr.
+ * Get masks of injection's fault model for a word of size bytes
  */
-static void ki_bitflip_rand(unsigned long addr, long count,
-                            struct ki_injection *injection)
+static void ki_fault_masks(struct ki_injection *injection,
+                           struct ki_pcpu *pcpu, unsigned int size,
+                           u64 *clear, u64 *set, u64 *flip)
 {
-        // We are using less random pseudo-generator
-        unsigned long finaladdr;
-        const int size = sizeof(unsigned long) + 1;
-        unsigned char random[size];
+        unsigned int bits = size * 8;
+        u64 word = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+        unsigned int n = min_t(u64, injection->fault_arg, bits);
+        u64 picked = 0;
+        bool invert;
+
+        *clear = *set = *flip = 0;
+
+        switch (injection->fault) {
+        case KI_FAULT_BITFLIP:
+                *flip = 1ULL << (ki_rand(pcpu) % bits);
+                break;
+        case KI_FAULT_BITS:
+                /* Pick the smaller set of bits, flipped or kept */
+                invert = n > bits / 2;
+                if (invert) n = bits - n;
+                while (hweight64(picked) < n)
+                        picked |= 1ULL << (ki_rand(pcpu) % bits);
+                *flip = invert ? word & ~picked : picked;
+                break;
+        case KI_FAULT_BURST:
+                *flip = (n == 64 ? ~0ULL : (1ULL << n) - 1) << 
+                        (ki_rand(pcpu) % (bits - n + 1));
+                break;
+        case KI_FAULT_XOR:
+                *flip = injection->fault_arg & word;
+                break;
+        case KI_FAULT_STUCK0:
+                *clear = injection->fault_arg & word;
+                break;
+        case KI_FAULT_STUCK1:
+                *set = injection->fault_arg & word;
+                break;
+        case KI_FAULT_RANDOM:
+                *clear = word;
+                *set = ki_rand(pcpu) & word;
+                break;
+        }
+}
 
-        // If available use passed seed
-        if (injection->seed)
-                prandom_seed(injection->seed);
+/*
+ * Apply injection's fault model to a random place in a sequence of count
+ * bytes starting under addr, within a place starting under base. BITFLIP
+ * inverts one bit of one byte, other models modify one naturally aligned
+ * word of up to 8 bytes.
+ */
+static void ki_bitflip_rand(unsigned long addr, long count, unsigned long base,
+                            struct ki_injection *injection,
+                            struct ki_poke *poke,
+                            enum ki_record_type_e type)
+{
+        unsigned int size;
+        unsigned long first;
+        u64 clear, set, flip;
+        struct ki_pcpu *pcpu = this_cpu_ptr(injection->pcpu);
+        u64 random = ki_rand(pcpu);
+
+        if (injection->fault == KI_FAULT_BITFLIP) {
+                ki_fault_word(addr + ((random >> 3) % count), 1,
+                              0, 0, 1ULL << (random & 7),
+                              injection, poke, type, base);
+                return;
+        }
 
-        // Get random bytes
-        prandom_bytes(random, size);
-        finaladdr = addr + (*(unsigned long*)random % count);
+        /* Find the largest aligned word fitting the sequence, aligned
+         * words never cross a page */
+        for (size = 8; size > 1; size >>= 1)
+                if (ALIGN(addr, size) + size <= addr + count) break;
+        first = ALIGN(addr, size);
 
-        ki_bitflip(finaladdr, random[size - 1] % 8, injection);
+        ki_fault_masks(injection, pcpu, size, &clear, &set, &flip);
+        ki_fault_word(first + (random % ((addr + count - first) / size)) * size,
+                      size, clear, set, flip, injection, poke, type, base);
 }
 
 /*
- * Invert one bit in registers
+ * Apply injection's fault model to registers. Word fault models modify
+ * a whole register.
  */
-static void ki_bitflip_regs(struct pt_regs *regs, struct ki_injection *injection)
+static void ki_bitflip_regs(struct pt_regs *regs, struct ki_injection *injection,
+                            struct ki_poke *poke)
 {
         /* Select byte and bit to modify */
         unsigned int byte;
-        int size = sizeof(unsigned int) + 1;
-        unsigned char random[size];
+        struct ki_pcpu *pcpu = this_cpu_ptr(injection->pcpu);
+        u64 random = ki_rand(pcpu);
+        u64 clear, set, flip;
         char *reg_name;
         unsigned int reg_size;
 
         reg_name = "?";
         reg_size = sizeof(regs->ax);
 
-        // If available use passed seed
-        if (injection->seed)
-                prandom_seed(injection->seed);
-
-        // Get random bytes
-        prandom_bytes(random, size);
-        byte = *((unsigned int*)random) % sizeof(*regs);
+        byte = (random >> 3) % sizeof(*regs);
+        if (injection->fault != KI_FAULT_BITFLIP)
+                byte &= ~(reg_size - 1);
 
         /* Get register name */
         IS_REG(byte, r15, "R15");
@@ -127,157 +231,769 @@ static void ki_bitflip_regs(struct pt_regs *regs, struct ki_injection *injection
         IS_REG(byte, sp, "RSP");
         IS_REG(byte, ss, "SS");
         
-        printk(MODULE_PRINTK_ERR "\tREG: %s 0x%lx+%u\n", reg_name,
-                                  (unsigned long)(regs), byte);
+        KI_LOG("\tREG: %s 0x%lx+%u\n", reg_name, (unsigned long)(regs), byte);
+
+        if (injection->fault == KI_FAULT_BITFLIP) {
+                ki_fault_word((unsigned long)(regs) + byte, 1,
+                              0, 0, 1ULL << (random & 7),
+                              injection, poke, KI_REC_REGS,
+                              (unsigned long)(regs));
+                return;
+        }
+
+        ki_fault_masks(injection, pcpu, reg_size, &clear, &set, &flip);
+        ki_fault_word((unsigned long)(regs) + byte, reg_size,
+                      clear, set, flip, injection, poke, KI_REC_REGS,
+                      (unsigned long)(regs));
+}
 
-        ki_bitflip((unsigned long)(regs) + byte,
-                   random[size - 1] % 8, injection);
+/*
+ * Inject into text bucket picked by module's profile, so executed code is
+ * hit more likely. Whole text is used while there is no profile.
+ */
+static void ki_inject_hot(struct ki_injection *injection,
+                          const struct ki_segment *text, struct ki_poke *poke)
+{
+        struct ki_profile *profile;
+        unsigned long addr = 0, size = 0;
+
+        profile = rcu_dereference_sched(injection->segments->profile);
+        if (profile && profile->start == text->start)
+                addr = ki_profile_pick(profile, 
+                                       ki_rand(this_cpu_ptr(injection->pcpu)),
+                                       &size);
+
+        if (!addr) {
+                addr = text->start;
+                size = text->size;
+        }
+
+        KI_LOG("\tCODE HOT 0x%lx:%lu\n", addr, size);
+        ki_bitflip_rand(addr, size, text->start, injection, poke, 
+                        KI_REC_CODE);
 }
 
 /*
- * Do immediate injection based on injection structure
+ * Do immediate injection based on injection structure. Process is true
+ * when called from campaign thread or command, not from trigger handler.
  */
 static void ki_do_injection(struct ki_injection *injection,
-                            struct pt_regs *regs)
+                            struct pt_regs *regs, bool process)
 {
+        struct ki_poke poke;
+        u64 start = ki_stats_timed() ? local_clock() : 0;
+
+        trace_ki_inject(injection);
+        ki_poke_start(&poke, process);
+
         if (injection->target.addr) {
                 unsigned long addr = injection->target.addr;
                 addr += injection->target_offset;
                 
-                printk(MODULE_PRINTK_ERR "\tTARGET 0x%lx (%s+%ld)\n",
+                KI_LOG("\tTARGET 0x%lx (%s+%ld)\n",
                        addr,
                        injection->target.name ? injection->target.name : "?",
                        injection->target_offset);
 
-                ki_bitflip_rand(addr, injection->bitflip, injection);
+                ki_bitflip_rand(addr, injection->bitflip, addr, injection,
+                                &poke, KI_REC_TARGET);
         }
 
         if (regs) {
                 if (injection->flags & KI_FLG_REGS) {
-                        ki_bitflip_regs(regs, injection);
+                        ki_bitflip_regs(regs, injection, &poke);
                 }
                 if (injection->flags & KI_FLG_STACK) {
-                        printk(MODULE_PRINTK_ERR "\tSTACK 0x%lx:10\n",
-                               (unsigned long) (regs->sp));
-                        ki_bitflip_rand(regs->sp, 10, injection);
+                        KI_LOG("\tSTACK 0x%lx:%d\n",
+                               (unsigned long) (regs->sp), KI_STACK_BYTES);
+                        ki_bitflip_rand(regs->sp, KI_STACK_BYTES, regs->sp,
+                                        injection, &poke, KI_REC_STACK);
+                }
+        }
+
+        if (injection->segments) {
+                int i;
+                struct ki_seg_map *map;
+
+                /* Module may be unloaded at the moment */
+                map = rcu_dereference_sched(injection->segments->map);
+                for (i = 0; map && i < ARRAY_SIZE(ki_seg_targets); ++i) {
+                        const struct ki_seg_target *t = &ki_seg_targets[i];
+                        const struct ki_segment *seg = &map->seg[t->seg];
+                        unsigned long addr = seg->start;
+
+                        if (!(injection->flags & t->flag) || !seg->size)
+                                continue;
+
+                        if (t->seg == KI_SEG_PERCPU)
+                                addr = (unsigned long) this_cpu_ptr(
+                                        (void __percpu*) addr);
+
+                        if (t->seg == KI_SEG_TEXT && 
+                            (injection->flags & KI_FLG_HOT)) {
+                                ki_inject_hot(injection, seg, &poke);
+                                continue;
+                        }
+
+                        KI_LOG("\t%s 0x%lx:%lu\n", t->name, addr, seg->size);
+                        ki_bitflip_rand(addr, seg->size, addr, injection,
+                                        &poke, t->type);
                 }
         }
 
-        if (injection->module) {
-                if (injection->flags & KI_FLG_DATA) {
-                        unsigned long addr;
-                        long size;
-                        addr = (unsigned long) 
-                               (injection->module->module_core) +
-                               injection->module->core_ro_size;
-                        size = injection->module->core_size -
-                               injection->module->core_ro_size;
+        /* Write all modifications together */
+        ki_poke_flush(&poke);
+        if (start)
+                ki_stats_time(this_cpu_ptr(injection->pcpu)->flip_ns,
+                              local_clock() - start);
+}
+
+/* --- REPLAY ------------------------------------------------------------- */
+/*
+ * Order REPLAY entries by CPU and hit
+ */
+static int ki_replay_cmp(const void *a, const void *b)
+{
+        const struct ki_replay *x = a, *y = b;
+
+        if (x->cpu != y->cpu) return x->cpu < y->cpu ? -1 : 1;
+        if (x->hit != y->hit) return x->hit < y->hit ? -1 : 1;
+        return 0;
+}
+
+/*
+ * Sort REPLAY entries and point every CPU at its first entry, CPUs
+ * without entries point past the last one. Must be called before trigger
+ * is armed.
+ * Returns true on success.
+ */
+static bool ki_arm_replay(struct ki_injection *injection, char **msg)
+{
+        unsigned int i;
+        int cpu;
+
+        for (i = 0; i < injection->replay_count; ++i) {
+                const struct ki_replay *replay = &injection->replay[i];
 
-                        printk(MODULE_PRINTK_ERR "\tDATA 0x%lx:%ld\n", addr, 
-                                                                       size);
-                        ki_bitflip_rand(addr, size, injection);
+                if (replay->cpu >= nr_cpu_ids || !cpu_possible(replay->cpu)) {
+                        *msg = "REPLAY CPU doesn't exist";
+                        return false;
                 }
-                if (injection->flags & KI_FLG_RODATA) {
-                        unsigned long addr;
-                        long size;
-                        addr = (unsigned long) 
-                               (injection->module->module_core) +
-                               injection->module->core_text_size;
-                        size = injection->module->core_ro_size - 
-                               injection->module->core_text_size;
-
-                        printk(MODULE_PRINTK_ERR "\tRODATA 0x%lx:%ld\n", addr
-                                                                       , size);
-                        ki_bitflip_rand(addr, size, injection);
+                if (replay->type == KI_REC_REGS &&
+                    !ki_replay_fits(replay, sizeof(struct pt_regs))) {
+                        *msg = "REPLAY REGS offset out of pt_regs";
+                        return false;
+                }
+        }
+
+        sort(injection->replay, injection->replay_count,
+             sizeof(*injection->replay), ki_replay_cmp, NULL);
+
+        for_each_possible_cpu(cpu)
+                per_cpu_ptr(injection->pcpu, cpu)->replay = 
+                        injection->replay_count;
+        for (i = injection->replay_count; i--; )
+                per_cpu_ptr(injection->pcpu, 
+                            injection->replay[i].cpu)->replay = i;
+        return true;
+}
+
+/*
+ * Check if REPLAY has entries for this hit of the CPU. Must be called with
+ * preemption disabled.
+ * Returns true if injection should be executed.
+ */
+static bool ki_replay_claim(struct ki_injection *injection,
+                            struct ki_pcpu *pcpu)
+{
+        const struct ki_replay *replay;
+
+        if (pcpu->replay >= injection->replay_count) return false;
+
+        replay = &injection->replay[pcpu->replay];
+        if (replay->cpu != smp_processor_id() ||
+            replay->hit != (u64) pcpu->hits)
+                return false;
+
+        pcpu->calls++;
+        return true;
+}
+
+/*
+ * Get start of place of a REPLAY entry, the same base its record's offset
+ * was counted from. Places are as large as injected by the recorded
+ * injection: BITFLIP bytes of the target, KI_STACK_BYTES of stack,
+ * pt_regs or the whole segment.
+ * Returns 0 if entry doesn't fit its place.
+ */
+static unsigned long ki_replay_base(struct ki_injection *injection,
+                                    struct ki_seg_map *map,
+                                    struct pt_regs *regs,
+                                    const struct ki_replay *replay)
+{
+        int i;
+
+        switch (replay->type) {
+        case KI_REC_TARGET:
+                if (!ki_replay_fits(replay, injection->bitflip)) return 0;
+                return injection->target.addr + injection->target_offset;
+        case KI_REC_STACK:
+                return regs && ki_replay_fits(replay, KI_STACK_BYTES) ? 
+                       regs->sp : 0;
+        case KI_REC_REGS:
+                return regs && ki_replay_fits(replay, sizeof(*regs)) ? 
+                       (unsigned long) regs : 0;
+        }
+
+        for (i = 0; map && i < ARRAY_SIZE(ki_seg_targets); ++i) {
+                const struct ki_seg_target *t = &ki_seg_targets[i];
+                const struct ki_segment *seg = &map->seg[t->seg];
+
+                if (t->type != replay->type) continue;
+                if (!ki_replay_fits(replay, seg->size)) return 0;
+                if (t->seg == KI_SEG_PERCPU)
+                        return (unsigned long) this_cpu_ptr(
+                                (void __percpu*) seg->start);
+                return seg->start;
+        }
+
+        return 0;
+}
+
+/*
+ * Repeat REPLAY entries of this hit of the CPU. Recorded changed bits are
+ * inverted, so word gets recorded value whenever it holds the same value
+ * as in the recorded run, whatever fault model was used. Entries which
+ * don't fit their place are skipped. Must be called with preemption
+ * disabled.
+ */
+static void ki_do_replay(struct ki_injection *injection, struct ki_pcpu *pcpu,
+                         struct pt_regs *regs)
+{
+        unsigned int i;
+        struct ki_poke poke;
+        struct ki_seg_map *map = NULL;
+        const struct ki_replay *replay;
+        unsigned int cpu = smp_processor_id();
+        u64 start = ki_stats_timed() ? local_clock() : 0;
+
+        trace_ki_inject(injection);
+        ki_poke_start(&poke, false);
+
+        /* Module may be unloaded at the moment */
+        if (injection->segments)
+                map = rcu_dereference_sched(injection->segments->map);
+
+        for (i = pcpu->replay; i < injection->replay_count; ++i) {
+                unsigned long base;
+
+                replay = &injection->replay[i];
+                if (replay->cpu != cpu || replay->hit != (u64) pcpu->hits)
+                        break;
+
+                base = ki_replay_base(injection, map, regs, replay);
+                if (!base) continue;
+
+                KI_LOG("\tREPLAY 0x%lx+0x%lx:%u\n", base, replay->offset,
+                       replay->size);
+                ki_fault_word(base + replay->offset, replay->size,
+                              0, 0, replay->mask, injection, &poke,
+                              replay->type, base);
+        }
+        pcpu->replay = i;
+
+        /* Write all modifications together */
+        ki_poke_flush(&poke);
+        if (start) ki_stats_time(pcpu->flip_ns, local_clock() - start);
+}
+
+/*
+ * Trigger hit handler shared by all trigger types. Injections attached to
+ * one trigger are executed in a single pass and logged as one injection,
+ * detached injections leave NULL entries. Must be called with preemption
+ * disabled.
+ * Returns true if any injection was executed.
+ */
+bool ki_execute_hit(struct ki_injection **injections, unsigned int count,
+                    struct pt_regs *regs)
+{
+        unsigned int i;
+        bool started = false;
+        u64 ns, start = ki_stats_timed() ? local_clock() : 0;
+
+        for (i = 0; i < count; ++i) {
+                struct ki_injection *injection = ACCESS_ONCE(injections[i]);
+                struct ki_pcpu *pcpu;
+                bool claimed;
+
+                /* Hits of injections not published yet are ignored */
+                if (!injection || !ACCESS_ONCE(injection->armed)) continue;
+                smp_rmb();
+
+                pcpu = this_cpu_ptr(injection->pcpu);
+                pcpu->hits++;
+                claimed = injection->replay_count ?
+                          ki_replay_claim(injection, pcpu) :
+                          ki_trigger_claim(injection, pcpu);
+                if (!claimed) {
+                        pcpu->rejected++;
+                        continue;
                 }
-                if (injection->flags & KI_FLG_CODE) {
-                        unsigned long addr;
-                        long size;
-                        addr = (unsigned long)
-                               (injection->module->module_core);
-                        size = injection->module->core_text_size;
-
-                        printk(MODULE_PRINTK_ERR "\tCODE 0x%lx:%ld\n", addr
-                                                                     , size);
-                        ki_bitflip_rand(addr, size, injection);
+
+                if (!started) {
+                        KI_LOG("--- INJECTION START ---\n");
+                        if (injection->timer_period)
+                                KI_LOG("\tTIMER %ldns\n",
+                                       injection->timer_period);
+                        else
+                                KI_LOG("\tTRIGGER 0x%lx (%s+%ld)\n",
+                                       injection->trigger.addr + 
+                                       injection->trigger_offset,
+                                       injection->trigger.name ? 
+                                       injection->trigger.name : "?",
+                                       injection->trigger_offset);
+                        started = true;
                 }
+
+                pcpu->hit = pcpu->hits;
+                if (injection->replay_count)
+                        ki_do_replay(injection, pcpu, regs);
+                else
+                        ki_do_injection(injection, regs, false);
+        }
+
+        if (started)
+                KI_LOG("--- INJECTION END ---\n");
+
+        if (!start) return started;
+
+        /* Handler time is per probe, it's not split between injections,
+         * every attached injection counts the whole handler */
+        ns = local_clock() - start;
+        for (i = 0; i < count; ++i) {
+                struct ki_injection *injection = ACCESS_ONCE(injections[i]);
+
+                if (!injection || !ACCESS_ONCE(injection->armed)) continue;
+                ki_stats_time(this_cpu_ptr(injection->pcpu)->handler_ns, ns);
         }
+        return started;
 }
 
 /*
- * Kprobe handler for trigger based injections
+ * Return handler of an injected function call. Must be called with
+ * preemption disabled.
  */
-static int ki_kp_pre_handler(struct kprobe *p, struct pt_regs *regs)
+void ki_execute_return(struct ki_injection *injection, unsigned long retval,
+                       u64 latency)
 {
-        struct ki_injection *injection = 
-                container_of(p, struct ki_injection, kp);
-        
-        /* Handle injection limits */
-        if (injection->max_inj && 
-            injection->calls >= injection->skipped_inj + injection->max_inj)
-                return 0;
-        
-        injection->calls++;
+        struct ki_pcpu *pcpu = this_cpu_ptr(injection->pcpu);
 
-        /* Handle skipped injections */
-        if (injection->skipped_inj && 
-            injection->calls <= injection->skipped_inj)
-                return 0;
+        pcpu->returned++;
+        if ((long) retval < 0) pcpu->errors++;
+        pcpu->latency += latency;
 
-        /* Execute injection */
-        printk(MODULE_PRINTK_ERR "--- INJECTION START ---\n");
-        printk(MODULE_PRINTK_ERR "\tTRIGGER 0x%lx (%s+%ld)\n",
-               injection->trigger.addr + injection->trigger_offset,
+        ki_record(injection, KI_REC_RETURN, retval, 0, latency, 0, 0, 0);
+        KI_LOG("\tRETURN 0x%lx (%s) %lluns\n", retval,
                injection->trigger.name ? injection->trigger.name : "?",
-               injection->trigger_offset);
+               latency);
+}
 
-        ki_do_injection(injection, regs);
-        printk(MODULE_PRINTK_ERR "--- INJECTION END ---\n");
+/*
+ * Campaign thread executing immediate injection repeatedly until number
+ * of injections or time limit is reached. Thread is stopped when campaign
+ * is removed.
+ */
+static int ki_campaign_thread(void *data)
+{
+        long i;
+        struct ki_injection *injection = data;
+        unsigned long deadline = jiffies + msecs_to_jiffies(injection->duration);
+
+        for (i = 0; i < injection->campaign && !kthread_should_stop(); ++i) {
+                if (injection->duration && time_after(jiffies, deadline))
+                        break;
+
+                preempt_disable();
+                KI_LOG("--- INJECTION START ---\n");
+                this_cpu_ptr(injection->pcpu)->hit = i + 1;
+                ki_do_injection(injection, NULL, true);
+                KI_LOG("--- INJECTION END ---\n");
+                this_cpu_ptr(injection->pcpu)->calls++;
+                preempt_enable();
+
+                /* Pace injections or at least let others run */
+                if (injection->interval)
+                        usleep_range(injection->interval,
+                                     injection->interval + 
+                                     injection->interval / 16 + 1);
+                else
+                        cond_resched();
+        }
+
+        /* Campaign is over, wait for removal */
+        ACCESS_ONCE(injection->finished) = 1;
+        set_current_state(TASK_INTERRUPTIBLE);
+        while (!kthread_should_stop()) {
+                schedule();
+                set_current_state(TASK_INTERRUPTIBLE);
+        }
+        __set_current_state(TASK_RUNNING);
 
         return 0;
 }
 
+/*
+ * Get time to next timer trigger, jitter is added randomly
+ */
+static ktime_t ki_timer_period(struct ki_injection *injection)
+{
+        u64 ns = injection->timer_period;
+
+        if (injection->timer_jitter)
+                ns += ki_rand(this_cpu_ptr(injection->pcpu)) % 
+                      (injection->timer_jitter + 1);
+
+        return ns_to_ktime(ns);
+}
+
+/*
+ * Hrtimer handler for timer based injections. Registers are not passed,
+ * timer interrupts unrelated code.
+ */
+static enum hrtimer_restart ki_timer_handler(struct hrtimer *timer)
+{
+        struct ki_pcpu *pcpu = container_of(timer, struct ki_pcpu, timer);
+        struct ki_injection *injection = pcpu->injection;
+
+        ki_execute_hit(&injection, 1, NULL);
+
+        /* No reason to wake up when budget is spent */
+        if (injection->max_inj && atomic64_read(&injection->budget) <= 0)
+                return HRTIMER_NORESTART;
+
+        hrtimer_forward_now(timer, ki_timer_period(injection));
+        return HRTIMER_RESTART;
+}
+
+/*
+ * Start timer of current CPU, called on every CPU for per CPU timers
+ */
+static void ki_timer_start(void *data)
+{
+        struct ki_injection *injection = data;
+
+        hrtimer_start(&this_cpu_ptr(injection->pcpu)->timer,
+                      ki_timer_period(injection), HRTIMER_MODE_REL_PINNED);
+}
+
+/*
+ * Start timer trigger. Per CPU timers are started on all online CPUs,
+ * otherwise one timer is started.
+ */
+static void ki_arm_timer(struct ki_injection *injection)
+{
+        int cpu;
 
+        for_each_possible_cpu(cpu) {
+                struct ki_pcpu *pcpu = per_cpu_ptr(injection->pcpu, cpu);
+                hrtimer_init(&pcpu->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+                pcpu->timer.function = ki_timer_handler;
+                pcpu->injection = injection;
+        }
+        injection->timer_ready = 1;
+
+        if (injection->flags & KI_FLG_TIMER_PERCPU) {
+                on_each_cpu(ki_timer_start, injection, 1);
+        } else {
+                preempt_disable();
+                hrtimer_start(&this_cpu_ptr(injection->pcpu)->timer,
+                              ki_timer_period(injection), HRTIMER_MODE_REL);
+                preempt_enable();
+        }
+}
+
+/*
+ * Publish triggered injections in the registry and let their triggers
+ * handle hits. Triggers are registered before, with hits ignored, so all
+ * injections of an ATOMIC batch start together. Must be called with
+ * registry writers lock held.
+ */
+static void ki_publish_injections(struct ki_injection **injections,
+                                  size_t count, struct idr *registry)
+{
+        size_t i;
+
+        for (i = 0; i < count; ++i) {
+                if (!injections[i] || !ki_is_triggered(injections[i]))
+                        continue;
+                idr_replace(registry, injections[i], injections[i]->id);
+                ki_stats_create(injections[i]);
+        }
+
+        /* Handlers see whole injections once they see them armed */
+        smp_wmb();
+        for (i = 0; i < count; ++i)
+                if (injections[i] && ki_is_triggered(injections[i]))
+                        ACCESS_ONCE(injections[i]->armed) = 1;
+}
+
+/*
+ * Register trigger of selected type. Timers are private to the injection,
+ * address triggers are attached to probes shared by injections.
+ * Returns true on success.
+ */
+static bool ki_arm_trigger(struct ki_injection *injection, char **msg)
+{
+        if (injection->timer_period) {
+                ki_arm_timer(injection);
+                return true;
+        }
+
+        return ki_probe_attach(injection, msg);
+}
 
 /*
  * Execute kernel injection. Injection structure should be validated before
- * usage. If injection is trigger based it added to the injection list.
+ * usage. If injection is trigger based it is added to the registry and its
+ * id is returned in status. Must be called with registry writers lock held.
  * Returns true on success
  */
 bool ki_execute_injection(struct ki_injection *injection, 
-                          struct list_head *injection_list,
-                          char **msg)
+                          struct idr *registry,
+                          struct ki_status *status)
 {
+        int id;
+        struct ki_injection *found;
+
         /* If clear is passed do clear */
         if (injection->flags & KI_FLG_CLEAR) {
-                ki_free_injection_list(injection_list);
+                ki_free_injections(registry);
+                ki_free_injection(injection);
+                return true;
+        }
+
+        /* Remove or show a single injection */
+        if (injection->flags & (KI_FLG_REMOVE | KI_FLG_SHOW)) {
+                found = idr_find(registry, injection->ref_id);
+                if (!found) {
+                        status->msg = "Injection not found";
+                        return false;
+                }
+
+                if (injection->flags & KI_FLG_REMOVE) {
+                        idr_remove(registry, found->id);
+                        ki_free_injection(found);
+                } else {
+                        status->id = found->id;
+                        status->show = true;
+                }
                 ki_free_injection(injection);
                 return true;
         }
 
-        /* If trigger is passed use kprobes */
-        if (injection->trigger.addr) {
-                injection->kp.addr = (kprobe_opcode_t*) (injection->trigger.addr);
-                injection->kp.addr += injection->trigger_offset;
-                injection->kp.pre_handler = ki_kp_pre_handler;
+        /* Reserve an id, injection is published when it's ready */
+        id = idr_alloc_cyclic(registry, NULL, 1, 0, GFP_KERNEL);
+        if (id < 0) {
+                status->msg = "Cannot allocate injection id";
+                return false;
+        }
+        injection->id = id;
+
+        /* Prepare per CPU state before handler can see it */
+        injection->pcpu = alloc_percpu(struct ki_pcpu);
+        if (!injection->pcpu) {
+                idr_remove(registry, id);
+                status->msg = "Cannot allocate injection counters";
+                return false;
+        }
+        ki_seed_injection(injection);
+
+        /* If trigger is passed use kprobes, ftrace or timer */
+        if (ki_is_triggered(injection)) {
+                atomic64_set(&injection->budget, injection->max_inj);
+                atomic64_set(&injection->skipped, injection->skipped_inj);
+
+                if (injection->replay_count &&
+                    !ki_arm_replay(injection, &status->msg)) {
+                        idr_remove(registry, id);
+                        return false;
+                }
                
                 /* Register it */
-                if (register_kprobe(&injection->kp) != 0) {
-                        injection->kp.addr = NULL;
-                        *msg = "Cannot register kprobe";
+                if (!ki_arm_trigger(injection, &status->msg)) {
+                        idr_remove(registry, id);
                         return false;
                 }
 
-                /* Add to the list */
-                list_add(&injection->list, injection_list);
+                /* ATOMIC batch publishes all its injections at once */
+                if (!(injection->flags & KI_FLG_ATOMIC))
+                        ki_publish_injections(&injection, 1, registry);
+                status->id = id;
                 return true;
         }
         
-        /* Immediate injection */
-        printk(MODULE_PRINTK_ERR "--- INJECTION START ---\n");
-        ki_do_injection(injection, NULL);
-        printk(MODULE_PRINTK_ERR "--- INJECTION END ---\n");
+        /* Campaign runs in its own thread and stays in the registry */
+        if (injection->campaign) {
+                struct task_struct *task;
+
+                task = kthread_run(ki_campaign_thread, injection,
+                                   MODULE_NAME_STR "/%d", id);
+                if (IS_ERR(task)) {
+                        idr_remove(registry, id);
+                        status->msg = "Cannot start campaign thread";
+                        return false;
+                }
+                injection->task = task;
+
+                idr_replace(registry, injection, id);
+                ki_stats_create(injection);
+                status->id = id;
+                return true;
+        }
+
+        /* Profile runs in its own thread and stays in the registry */
+        if (injection->profile) {
+                if (!ki_profile_start(injection, &status->msg)) {
+                        idr_remove(registry, id);
+                        return false;
+                }
+
+                idr_replace(registry, injection, id);
+                ki_stats_create(injection);
+                status->id = id;
+                return true;
+        }
+
+        /* Immediate injection keeps its id only while it's executed */
+        KI_LOG("--- INJECTION START ---\n");
+        preempt_disable();
+        ki_do_injection(injection, NULL, true);
+        preempt_enable();
+        KI_LOG("--- INJECTION END ---\n");
+        idr_remove(registry, id);
         ki_free_injection(injection);
         return true;
 }
 
+/*
+ * Validate injection and trace the result
+ * Returns true on success.
+ */
+static bool ki_validate(struct ki_injection *injection, char **msg)
+{
+        bool ok = ki_validate_injection(injection, msg);
+
+        trace_ki_validate(injection, ok, ok ? "OK" : *msg);
+        return ok;
+}
+
+/*
+ * Execute a batch of parsed commands. Commands which failed to parse are
+ * passed as NULL with their status already set. If any command has ATOMIC
+ * flag, whole batch is validated before execution and nothing is armed
+ * when any command fails. Successful commands have ok set in their status.
+ * Batch takes ownership of all injections.
+ * Must be called with registry writers lock held.
+ * Returns true if all commands succeeded.
+ */
+bool ki_execute_batch(struct ki_injection **injections, size_t count,
+                      struct idr *registry,
+                      struct ki_status *status)
+{
+        size_t i;
+        bool atomic = false;
+        bool failed = false;
+
+        for (i = 0; i < count; ++i) {
+                if (!injections[i]) failed = true;
+                else if (injections[i]->flags & KI_FLG_ATOMIC) atomic = true;
+        }
+
+        /* Not atomic batch is executed command by command */
+        if (!atomic) {
+                for (i = 0; i < count; ++i) {
+                        if (!injections[i]) continue;
+                        if (!ki_validate(injections[i], &status[i].msg) ||
+                            !ki_execute_injection(injections[i], registry,
+                                                  &status[i])) {
+                                ki_free_injection(injections[i]);
+                                failed = true;
+                        } else {
+                                status[i].ok = true;
+                        }
+                        injections[i] = NULL;
+                }
+                return !failed;
+        }
+
+        /* Validate whole batch first */
+        for (i = 0; i < count; ++i) {
+                if (!injections[i]) continue;
+                if (injections[i]->flags & (KI_FLG_CLEAR | KI_FLG_REMOVE)) {
+                        status[i].msg = "CLEAR, REMOVE not allowed in "
+                                        "ATOMIC batch";
+                } else if (ki_validate(injections[i], &status[i].msg))
+                        continue;
+
+                ki_free_injection(injections[i]);
+                injections[i] = NULL;
+                failed = true;
+        }
+        if (failed) goto abort;
+
+        /* Register triggers with hits ignored, until now everything can
+         * be taken back */
+        for (i = 0; i < count; ++i) {
+                if (!ki_is_triggered(injections[i])) continue;
+                injections[i]->flags |= KI_FLG_ATOMIC;
+                if (!ki_execute_injection(injections[i], registry,
+                                          &status[i])) {
+                        ki_free_injection(injections[i]);
+                        injections[i] = NULL;
+                        failed = true;
+                        break;
+                }
+                status[i].ok = true;
+        }
+
+        if (failed) {
+                /* Disarm triggers armed by this batch */
+                while (i--) {
+                        if (!ki_is_triggered(injections[i])) continue;
+                        idr_remove(registry, injections[i]->id);
+                        ki_free_injection(injections[i]);
+                        injections[i] = NULL;
+                        status[i].msg = "ATOMIC batch aborted";
+                        status[i].id = 0;
+                        status[i].ok = false;
+                }
+                goto abort;
+        }
+
+        /* All triggers are registered, let them fire together */
+        ki_publish_injections(injections, count, registry);
+
+        /* Immediate injections cannot be reverted so they go last */
+        for (i = 0; i < count; ++i) {
+                if (!ki_is_triggered(injections[i])) {
+                        if (ki_execute_injection(injections[i], registry,
+                                                 &status[i])) {
+                                status[i].ok = true;
+                        } else {
+                                ki_free_injection(injections[i]);
+                                failed = true;
+                        }
+                }
+                injections[i] = NULL;
+        }
+        return !failed;
+
+abort:
+        for (i = 0; i < count; ++i) {
+                if (!injections[i]) continue;
+                ki_free_injection(injections[i]);
+                injections[i] = NULL;
+                status[i].msg = "ATOMIC batch aborted";
+        }
+        return false;
+}
@@ -19,13 +19,35 @@
 #ifndef KI_EXECUTE_H
 #define KI_EXECUTE_H
 
-#include <linux/list.h>
+#include <linux/types.h>
 
+struct idr;
+struct pt_regs;
 struct ki_injection;
 
+/* --- EXECUTOR STRUCTURES ------------------------------------------------ */
+/*
+ * Result of one command of a batch
+ */
+struct ki_status
+{
+        size_t  pos;    /* Last parser position in a command */
+        char   *msg;    /* Result description */
+        int     id;     /* Id of armed or shown injection, 0 if none */
+        bool    show;   /* SHOW command, list only injection with the id */
+        bool    ok;     /* Command succeeded, msg is not an error */
+};
+
 /* --- EXECUTOR FUNCTIONS ------------------------------------------------- */
 bool ki_execute_injection(struct ki_injection *injection, 
-                          struct list_head *injection_list,
-                          char **msg); 
+                          struct idr *registry,
+                          struct ki_status *status); 
+bool ki_execute_batch(struct ki_injection **injections, size_t count,
+                      struct idr *registry,
+                      struct ki_status *status);
+bool ki_execute_hit(struct ki_injection **injections, unsigned int count,
+                    struct pt_regs *regs);
+void ki_execute_return(struct ki_injection *injection, unsigned long retval,
+                       u64 latency);
 
 #endif /*KI_EXECUTE_H*/
@@ -19,8 +19,12 @@
 #include <linux/string.h>
 #include <linux/slab.h>
 #include <linux/module.h>
+#include <linux/kthread.h>
 #include "injection.h"
 #include "kinjector.h"
+#include "probe.h"
+#include "profile.h"
+#include "stats.h"
 
 /*
  * Initialize kernel injection structure
@@ -31,188 +35,119 @@ void ki_init_injection(struct ki_injection *injection)
 }
 
 /*
- * Free kernel injection structure
+ * Free memory of an injection after RCU readers are done with it
  */
-void ki_free_injection(struct ki_injection *injection)
+static void ki_free_injection_rcu(struct rcu_head *head)
 {
-        if (injection->kp.addr) unregister_kprobe(&injection->kp);
+        struct ki_injection *injection;
+        injection = container_of(head, struct ki_injection, rcu);
+
+        if (injection->pcpu) free_percpu(injection->pcpu);
         if (injection->target.name) kfree(injection->target.name);
         if (injection->trigger.name) kfree(injection->trigger.name);
         if (injection->module_name) kfree(injection->module_name);
+        if (injection->samples) ki_profile_free(injection->samples);
+        if (injection->replay) kfree(injection->replay);
         kfree(injection);
 }
 
 /*
- * Free all kernel injections from a list
+ * Wait for registry readers after probe handlers are done with injection
  */
-void ki_free_injection_list(struct list_head *list)
+static void ki_free_injection_sched(struct rcu_head *head)
 {
-        struct list_head *pos, *n;
-        struct ki_injection *injection;
-        list_for_each_safe(pos, n, list) {
-                injection = list_entry(pos, struct ki_injection, list);
-                list_del(pos);
-                ki_free_injection(injection);
-        }
+        call_rcu(head, ki_free_injection_rcu);
 }
 
 /*
- * Print injection structure to syslog
+ * Free kernel injection structure. Injection must be already removed from
+ * the registry, registry readers and probe handlers can use it until grace
+ * periods end. Must be called with registry writers lock held if injection
+ * is attached to a probe.
  */
-static void ki_print_injection(struct ki_injection *injection)
+void ki_free_injection(struct ki_injection *injection)
 {
-        printk(MODULE_PRINTK_DBG "Kernel injection: \n");
-        
-        if (injection->target.name)
-                printk(MODULE_PRINTK_DBG "Target: %s +(%ld)\n", 
-                       injection->target.name, injection->target_offset);
-        else
-                printk(MODULE_PRINTK_DBG "Target: %lx +(%ld)\n", 
-                       injection->target.addr, injection->target_offset);
-
-        if (injection->trigger.name)
-                printk(MODULE_PRINTK_DBG "Trigger: %s +(%ld)\n", 
-                       injection->trigger.name, injection->trigger_offset);
-        else
-                printk(MODULE_PRINTK_DBG "Trigger: %lx +(%ld)\n", 
-                       injection->trigger.addr, injection->trigger_offset);
-
-        if (injection->module_name)
-                printk(MODULE_PRINTK_DBG "Module: %s\n", 
-                       injection->module_name);
-
-        printk(MODULE_PRINTK_DBG "Max injections: %ld\n", injection->max_inj);
-        printk(MODULE_PRINTK_DBG "Skipped injections: %ld\n", 
-               injection->skipped_inj);
-        printk(MODULE_PRINTK_DBG "Bitflip: %ld\n", injection->bitflip);
-
-        printk(MODULE_PRINTK_DBG "Flags: ");
-        if (injection->flags & KI_FLG_STACK) printk(KERN_CONT "STACK |");
-        if (injection->flags & KI_FLG_REGS) printk(KERN_CONT "REGS |");
-        if (injection->flags & KI_FLG_DATA) printk(KERN_CONT "DATA |");
-        if (injection->flags & KI_FLG_RODATA) printk(KERN_CONT "RODATA |");
-        if (injection->flags & KI_FLG_CODE) printk(KERN_CONT "CODE |");
-        if (injection->flags & KI_FLG_CLEAR) printk(KERN_CONT "CLEAR |");
-        printk(KERN_CONT "\n");
-
-        printk(MODULE_PRINTK_DBG "Debug: %d\n", injection->debug);
-
-        printk(MODULE_PRINTK_DBG "Seed: %lu\n", injection->seed);
+        if (injection->task) kthread_stop(injection->task);
+        if (injection->timer_ready) {
+                int cpu;
+                for_each_possible_cpu(cpu)
+                        hrtimer_cancel(&per_cpu_ptr(injection->pcpu, 
+                                                    cpu)->timer);
+        }
+        if (injection->probe) ki_probe_detach(injection);
+        ki_stats_remove(injection);
+        call_rcu_sched(&injection->rcu, ki_free_injection_sched);
 }
 
 /*
- * Validate injection structure.
- * Return true on success. Information about eventual failure is passed
- * to msg variable.
+ * Free all kernel injections from a registry. Must be called with
+ * registry writers lock held.
  */
-bool ki_validate_injection(struct ki_injection *injection, char **msg)
+void ki_free_injections(struct idr *registry)
 {
-        /* Print injection structure */
-        ki_print_injection(injection);
-
-        /* Check clear flag first */
-        if (injection->flags & KI_FLG_CLEAR) return true;
-
-        /* If we have a module get its pointer */
-        if (injection->module_name) {
-                mutex_lock(&module_mutex);
-                injection->module = find_module(injection->module_name);
-                mutex_unlock(&module_mutex);
-                
-                if (!injection->module) {
-                        *msg = "Module not found";
-                        return false;
-                }
-        }
-
-        /* If we have a target symbol, get it's address */
-        if (injection->target.name) {
-                injection->target.addr 
-                        = kallsyms_lookup_name(injection->target.name);
-                if (!injection->target.addr) {
-                        *msg = "Injection symbol not found";
-                        return false;
-                }
-        }
-     
-        /* We cannot do direct injection without bitflip specified */
-        if (injection->target.addr) {
-                if (!injection->bitflip) {
-                        *msg = "INJECT_INTO requires BITFLIP";
-                        return false;
-                }
-        }
-
-        /* If we have trigger symbol, get it's address */
-        if (injection->trigger.name) {
-                injection->trigger.addr 
-                        = kallsyms_lookup_name(injection->trigger.name);
-                if (!injection->trigger.addr) {
-                        *msg = "Trigger symbol not found";
-                        return false;
-                }
-        }
-
-        /* BITFLIP requires target */
-        if (injection->bitflip && !injection->target.addr) {
-                *msg = "BITFLIP requires INJECT_INTO";
-                return false;
-        }
-
-        /* STACK | REGS require trigger */
-        if ((injection->flags & (KI_FLG_STACK | KI_FLG_REGS)) &&
-             !injection->trigger.addr) {
-                *msg = "CODE, REGS require TRIGGER";
-                return false;
-        }
-
-        /* RODATA | DATA | CODE require MODULE */
-        if ((injection->flags & (KI_FLG_RODATA | KI_FLG_DATA | KI_FLG_CODE)) &&
-             !injection->module) {
-                *msg = "RODATA, DATA, CODE require MODULE";
-                return false;
-        }
-
-        /* Inject offset require injection target */
-        if (injection->target_offset && !injection->target.addr) {
-                *msg = "INJECT_OFFSET require INJECT_INTO";
-                return false;
+        int id;
+        struct ki_injection *injection;
+        idr_for_each_entry(registry, injection, id) {
+                idr_remove(registry, id);
+                ki_free_injection(injection);
         }
+}
 
-        /* Trigger offset require trigger */
-        if (injection->trigger_offset && !injection->trigger.addr) {
-                *msg = "TRIGGER_OFFSET require TRIGGER";
-                return false;
-        }
+/*
+ * Check if address belongs to a module
+ */
+static bool ki_within_module(unsigned long addr, struct module *mod)
+{
+        return within_module_core(addr, mod) || within_module_init(addr, mod);
+}
 
-        /* Max number of injections must be positive */
-        if (injection->max_inj < 0) {
-                *msg = "MAX_INJECTIONS must be >= 0";
-                return false;
+/*
+ * Free injections triggered in a module or injecting into a module's
+ * symbol. Injections into MODULE segments are kept, they are idle until
+ * the module is loaded again. Must be called with registry writers lock
+ * held.
+ */
+void ki_free_module_injections(struct idr *registry, struct module *mod)
+{
+        int id;
+        struct ki_injection *injection;
+        idr_for_each_entry(registry, injection, id) {
+                if (!ki_within_module(injection->trigger.addr, mod) &&
+                    !ki_within_module(injection->target.addr, mod))
+                        continue;
+                idr_remove(registry, id);
+                ki_free_injection(injection);
         }
+}
 
-        /* If maximum number of injections is specified, trigger
-         * must exist.
-         */
-        if (injection->max_inj && !injection->trigger.addr) {
-                *msg = "MAX_INJECTIONS require TRIGGER";
-                return false;
-        }
+/*
+ * Sum up completed injections from all CPUs
+ */
+long ki_injection_calls(struct ki_injection *injection)
+{
+        int cpu;
+        long calls = 0;
 
-        /* Number of skipped injections must be positive */
-        if (injection->skipped_inj < 0) {
-                *msg = "SKIPPED_INJECTIONS must be >= 0";
-                return false;
-        }
+        if (!injection->pcpu) return 0;
+        for_each_possible_cpu(cpu)
+                calls += per_cpu_ptr(injection->pcpu, cpu)->calls;
+        return calls;
+}
 
-        /* If a number of skipped injections is specified, trigger
-         * must exist.
-         */
-        if (injection->skipped_inj && !injection->trigger.addr) {
-                *msg = "SKIPPED_INJECTIONS require TRIGGER";
-                return false;
+/*
+ * Sum up outcome of injected calls from all CPUs
+ */
+void ki_injection_outcome(struct ki_injection *injection, long *returned,
+                          long *errors, u64 *latency)
+{
+        int cpu;
+
+        *returned = *errors = *latency = 0;
+        if (!injection->pcpu) return;
+        for_each_possible_cpu(cpu) {
+                struct ki_pcpu *pcpu = per_cpu_ptr(injection->pcpu, cpu);
+                *returned += pcpu->returned;
+                *errors += pcpu->errors;
+                *latency += pcpu->latency;
         }
-
-        return true;
 }
-
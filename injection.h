@@ -19,9 +19,16 @@
 #ifndef KI_INJECTION_H
 #define KI_INJECTION_H
 
-#include <linux/kprobes.h>
-#include <linux/list.h>
+#include <linux/hrtimer.h>
+#include <linux/idr.h>
+#include <linux/percpu.h>
+#include <linux/atomic.h>
 struct module;
+struct task_struct;
+struct ki_probe;
+struct ki_segments;
+struct ki_profile;
+struct dentry;
 
 /* --- INJECTION STRUCTURES -------------------------------------------------- */
 /*
@@ -44,7 +51,113 @@ enum ki_flags_e
         KI_FLG_DATA   = 4,
         KI_FLG_RODATA = 8,
         KI_FLG_CODE   = 16,
-        KI_FLG_CLEAR  = 32
+        KI_FLG_CLEAR  = 32,
+        KI_FLG_ATOMIC = 64,
+        KI_FLG_REMOVE = 128,
+        KI_FLG_SHOW   = 256,
+        KI_FLG_TIMER_PERCPU = 512,
+        KI_FLG_BSS    = 1024,
+        KI_FLG_INIT   = 2048,
+        KI_FLG_PERCPU = 4096,
+        KI_FLG_HOT    = 8192,
+        KI_FLG_OUTCOME = 16384
+};
+
+/* Flags injecting into segments of MODULE */
+#define KI_FLG_SEGMENTS (KI_FLG_DATA | KI_FLG_RODATA | KI_FLG_CODE | \
+                         KI_FLG_BSS | KI_FLG_INIT | KI_FLG_PERCPU)
+
+/*
+ * Trigger types
+ */
+enum ki_trigger_mode_e
+{
+        KI_TRIG_AUTO   = 0,
+        KI_TRIG_KPROBE = 1,
+        KI_TRIG_FTRACE = 2,
+        KI_TRIG_KRETPROBE = 3   /* Private probe of OUTCOME injection */
+};
+
+/*
+ * Trigger scheduling policies
+ */
+enum ki_sched_e
+{
+        KI_SCHED_ALWAYS      = 0,
+        KI_SCHED_PROBABILITY = 1,
+        KI_SCHED_EVERY       = 2,
+        KI_SCHED_POISSON     = 3
+};
+
+/*
+ * Fault models. Every model except BITFLIP modifies one word of up to
+ * 8 bytes.
+ */
+enum ki_fault_e
+{
+        KI_FAULT_BITFLIP = 0,   /* One bit of one byte */
+        KI_FAULT_BITS    = 1,   /* N distinct random bits */
+        KI_FAULT_BURST   = 2,   /* N adjacent bits */
+        KI_FAULT_XOR     = 3,   /* Bits of a mask inverted */
+        KI_FAULT_STUCK0  = 4,   /* Bits of a mask cleared */
+        KI_FAULT_STUCK1  = 5,   /* Bits of a mask set */
+        KI_FAULT_RANDOM  = 6    /* Word replaced with a random value */
+};
+
+/* Buckets of log2 nanoseconds histograms */
+#define KI_STATS_BUCKETS 32
+
+/* Maximal number of REPLAY entries of one injection */
+#define KI_REPLAY_MAX 65536
+
+/* Bytes of stack above stack pointer injected by STACK */
+#define KI_STACK_BYTES 10
+
+/* Shortest TRIGGER_TIMER period in ns, shorter would livelock CPUs */
+#define KI_TIMER_MIN_PERIOD 10000
+
+/*
+ * Modification repeated by REPLAY, fields match struct ki_record
+ */
+struct ki_replay
+{
+        u64           hit;      /* Hit ordinal of the CPU */
+        u64           mask;     /* Bits inverted in the word */
+        unsigned long offset;   /* Offset from start of the type */
+        unsigned int  cpu;
+        u8            type;     /* enum ki_record_type_e */
+        u8            size;     /* Size of the word in bytes */
+};
+
+/*
+ * Check if word of a REPLAY entry fits limit bytes of its place, sum of
+ * offset and size is never computed so it can't overflow
+ */
+static inline bool ki_replay_fits(const struct ki_replay *replay,
+                                  unsigned long limit)
+{
+        return replay->size <= limit && replay->offset <= limit - replay->size;
+}
+
+/*
+ * Per CPU injection state
+ */
+struct ki_pcpu
+{
+        long hits;              /* Trigger hits */
+        long rejected;          /* Hits not claimed for an injection */
+        long calls;             /* Completed injections */
+        u64  rand;              /* Pseudo-random generator state */
+        long countdown;         /* Hits left to scheduled injection */
+        long hit;               /* Hit ordinal being injected, recorded */
+        unsigned int replay;    /* Next REPLAY entry of this CPU */
+        long returned;          /* Injected calls which returned */
+        long errors;            /* Returned calls with negative value */
+        u64  latency;           /* Sum of injected calls latency in ns */
+        unsigned long handler_ns[KI_STATS_BUCKETS]; /* Hit handler time */
+        unsigned long flip_ns[KI_STATS_BUCKETS];    /* Injection time */
+        struct hrtimer timer;   /* Timer trigger */
+        struct ki_injection *injection;
 };
 
 /*
@@ -52,27 +165,63 @@ enum ki_flags_e
  */
 struct ki_injection
 {
+        int              id;
         struct ki_symbol target;
         long             target_offset;
         struct ki_symbol trigger;
         long             trigger_offset;
-        struct module    *module;
+        enum ki_trigger_mode_e trigger_mode;
+        long             timer_period; /* Timer trigger period in ns */
+        long             timer_jitter; /* Maximal random delay in ns */
+        int              timer_ready;  /* Timers are initialized */
+        int              armed;        /* Trigger hits are handled */
+        struct ki_segments *segments;  /* Segment table of MODULE */
         char             *module_name;
         long             bitflip;
+        enum ki_fault_e  fault;
+        u64              fault_arg;    /* Number of bits or mask */
         long             max_inj;
         long             skipped_inj;
-        long             calls;
+        enum ki_sched_e  sched;
+        u64              sched_arg;    /* Probability * 2^32, stride, mean */
+        struct ki_pcpu __percpu *pcpu;
+        atomic64_t       budget;       /* Injections left of max_inj */
+        atomic64_t       skipped;      /* Calls left to skip */
         int              debug;
         long             seed;
         enum ki_flags_e  flags;
-        struct kprobe    kp;
-        struct list_head list;
+        long             ref_id;       /* Id passed to REMOVE or SHOW */
+        long             campaign;     /* Number of campaign injections */
+        long             interval;     /* Microseconds between injections */
+        long             duration;     /* Campaign time limit in ms */
+        struct task_struct *task;      /* Campaign thread */
+        int              finished;     /* Campaign or profile is done */
+        long             profile;      /* Profiling time in ms */
+        struct ki_profile *samples;    /* Profile being collected */
+        struct ki_replay *replay;      /* REPLAY entries */
+        unsigned int     replay_count;
+        unsigned int     replay_size;  /* Allocated REPLAY entries */
+        struct ki_probe  *probe;       /* Shared trigger probe */
+        struct dentry    *stats;       /* Statistics file in debugfs */
+        struct rcu_head  rcu;
 };
 
 /* --- INJECTION UTILITY FUNCTIONS ---------------------------------------- */
+/*
+ * Check if injection is executed by a trigger instead of immediately
+ */
+static inline bool ki_is_triggered(struct ki_injection *injection)
+{
+        return injection->trigger.addr || injection->timer_period;
+}
+
 void ki_init_injection(struct ki_injection *injection);
 void ki_free_injection(struct ki_injection *injection);
-void ki_free_injection_list(struct list_head *list);
+void ki_free_injections(struct idr *registry);
+void ki_free_module_injections(struct idr *registry, struct module *mod);
+long ki_injection_calls(struct ki_injection *injection);
+void ki_injection_outcome(struct ki_injection *injection, long *returned,
+                          long *errors, u64 *latency);
 bool ki_validate_injection(struct ki_injection *injection, char **msg);
 
 #endif /*KI_INJECTION_H*/
@@ -20,32 +20,134 @@
 #include <linux/proc_fs.h>
 #include <linux/uaccess.h>
 #include <linux/seq_file.h>
-#include <linux/list.h>
+#include <linux/idr.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
 #include <linux/slab.h>
+#include <linux/ctype.h>
+#include <linux/math64.h>
 
+#define CREATE_TRACE_POINTS
+#include "trace.h"
 #include "parser.h"
 #include "injection.h"
 #include "kinjector.h"
 #include "execute.h"
+#include "records.h"
+#include "symcache.h"
+#include "poke.h"
+#include "probe.h"
+#include "segment.h"
+#include "device.h"
+#include "netlink.h"
+#include "stats.h"
 
 MODULE_AUTHOR("Przemysław Lenart <przemek.lenart@gmail.com>");
 MODULE_DESCRIPTION("Linux kernel injector");
 MODULE_VERSION("0.2");
 MODULE_LICENSE("GPL");
 
+/* --- STRUCTURES ---------------------------------------------------------- */
+/*
+ * Results of the last batch of commands. Replaced as a whole and freed
+ * after RCU grace period, so readers never see a partial update.
+ */
+struct ki_batch
+{
+        struct rcu_head  rcu;
+        size_t           count;      /* Commands in batch */
+        int              show_id;    /* Only injection listed, 0 for all */
+        struct ki_status status[];
+};
+
 /* --- GLOBALS ------------------------------------------------------------- */ 
-static LIST_HEAD(ki_injection_list); /* List of all trigger based injections */
-static char *ki_msg = "No command";  /* Last message sent to user */
-static size_t ki_pos = 0;            /* Last position in command buffer */
+static DEFINE_IDR(ki_registry);      /* All trigger based injections by id */
+static DEFINE_MUTEX(ki_mutex);       /* Serializes registry writers */
+static struct ki_batch ki_no_batch = {
+        .count  = 1,
+        .status = { { 0, "No command" } }
+};
+static struct ki_batch __rcu *ki_batch = &ki_no_batch; /* Last results */
+
+/* --- REGISTRY ------------------------------------------------------------ */
+/*
+ * Execute a batch of injections which didn't come from procfs. Results are
+ * stored only in status, last batch listed by procfs is left untouched.
+ * Returns true if all commands succeeded.
+ */
+bool ki_registry_execute(struct ki_injection **injections, size_t count,
+                         struct ki_status *status)
+{
+        bool ret;
+
+        mutex_lock(&ki_mutex);
+        ret = ki_execute_batch(injections, count, &ki_registry, status);
+        ki_netlink_status(status, count);
+        mutex_unlock(&ki_mutex);
+        return ret;
+}
+
+/*
+ * Find injection by its id. Must be called in RCU read side section.
+ */
+struct ki_injection *ki_registry_find(int id)
+{
+        return idr_find(&ki_registry, id);
+}
 
 /* --- PROCFS -------------------------------------------------------------- */
 /*
- * Function reading input form user in form of a command.
+ * Find next not empty command line starting from *start.
+ * Returns true if command was found, its end is stored in *end.
+ */
+static bool ki_next_command(const char *buffer, size_t len, size_t *start,
+                            size_t *end)
+{
+        while (*start < len) {
+                size_t pos = *start;
+
+                *end = pos;
+                while (*end < len && buffer[*end] != '\n') ++*end;
+
+                /* Skip lines without any keyword */
+                while (pos < *end && isspace(buffer[pos])) ++pos;
+                if (pos < *end && !iscntrl(buffer[pos])) return true;
+
+                *start = *end + 1;
+        }
+
+        return false;
+}
+
+/*
+ * Replace results of the last batch. Must be called with ki_mutex held.
+ */
+static void ki_set_batch(struct ki_batch *batch)
+{
+        size_t i;
+        struct ki_batch *old;
+
+        /* Last successful SHOW limits listing to one injection */
+        for (i = 0; i < batch->count; ++i)
+                if (batch->status[i].show) 
+                        batch->show_id = batch->status[i].id;
+
+        old = rcu_dereference_protected(ki_batch, lockdep_is_held(&ki_mutex));
+        rcu_assign_pointer(ki_batch, batch);
+        if (old != &ki_no_batch) kfree_rcu(old, rcu);
+}
+
+/*
+ * Function reading input form user in form of a command batch. Every line
+ * of the input is a separate command. Commands are parsed in parallel with
+ * other writers, only execution is serialized.
  */
 ssize_t ki_write(struct file *filp, const char *buffer, size_t len,
                  loff_t *f_pos)
 {
-        struct ki_injection *injection;
+        size_t i, start, end, count;
+        struct ki_batch *batch;
+        struct ki_injection **injections;
 
         /* Allocate memory for a message and copy it to kernel space */
         char *msg = kmalloc(len + 1, GFP_KERNEL);
@@ -56,40 +158,112 @@ ssize_t ki_write(struct file *filp, const char *buffer, size_t len,
         }
         msg[len] = '\0';
 
-        /* Allocate memory for injection structure and initialize it */
-        injection = kmalloc(sizeof(*injection), GFP_KERNEL);
-        if (!injection) {
+        /* Count commands to size the batch */
+        count = 0;
+        for (start = 0; ki_next_command(msg, len, &start, &end); 
+             start = end + 1)
+                ++count;
+        trace_ki_command(len, count);
+
+        if (!count) {
+                mutex_lock(&ki_mutex);
+                ki_set_batch(&ki_no_batch);
+                mutex_unlock(&ki_mutex);
+                kfree(msg);
+                return len;
+        }
+
+        batch = kzalloc(sizeof(*batch) + count * sizeof(batch->status[0]),
+                        GFP_KERNEL);
+        injections = kcalloc(count, sizeof(*injections), GFP_KERNEL);
+        if (!batch || !injections) {
+                kfree(batch);
+                kfree(injections);
                 kfree(msg);
                 return -ENOMEM;
         }
-        ki_init_injection(injection);
+        batch->count = count;
 
-        /* Parse command and if succeeded execute it */ 
-        printk(MODULE_PRINTK_DBG "Got command: %s", msg);
-       
-        if (!ki_parse(msg, len, &ki_pos, injection, &ki_msg)) goto fail;
-        if (!ki_validate_injection(injection, &ki_msg)) goto fail;
-        if (!ki_execute_injection(injection, &ki_injection_list, &ki_msg)) 
-                goto fail;
-        goto success;
-
-fail:
-        /* Injection not used... free it */
-        ki_free_injection(injection);
-
-success:
-        /* Free buffer, whole message was read */
+        /* Parse all commands, failed ones are left as NULL */
+        i = 0;
+        for (start = 0; ki_next_command(msg, len, &start, &end);
+             start = end + 1, ++i) {
+                struct ki_injection *injection;
+
+                injection = kmalloc(sizeof(*injection), GFP_KERNEL);
+                if (!injection) {
+                        batch->status[i].msg = "Out of memory";
+                        continue;
+                }
+                ki_init_injection(injection);
+
+                if (!ki_parse(msg + start, end - start, &batch->status[i].pos,
+                              injection, &batch->status[i].msg)) {
+                        trace_ki_parse_error(i, batch->status[i].pos,
+                                             batch->status[i].msg);
+                        ki_free_injection(injection);
+                        continue;
+                }
+                injections[i] = injection;
+        }
+
+        /* Validate and execute, batch takes care of injections */
+        mutex_lock(&ki_mutex);
+        ki_execute_batch(injections, count, &ki_registry, batch->status);
+        ki_netlink_status(batch->status, count);
+        ki_set_batch(batch);
+        mutex_unlock(&ki_mutex);
+
+        /* Free buffers, whole message was read */
+        kfree(injections);
         kfree(msg);
         return len;
 }
 
 /*
- * Sequence file's start iterator
+ * Check if sequence iterator points at a status line
+ */
+static bool ki_seq_is_status(struct ki_batch *batch, void *v)
+{
+        return v >= (void*)batch->status && 
+               v < (void*)(batch->status + batch->count);
+}
+
+/*
+ * Find element at given position. Status lines of last batch go first,
+ * then trigger based injections. Position of an injection is its id added
+ * to number of status lines, so seeking doesn't walk the registry.
+ */
+static void *ki_seq_find(struct ki_batch *batch, loff_t *pos)
+{
+        int id;
+        struct ki_injection *injection;
+
+        if (*pos < batch->count) return &batch->status[*pos];
+        if (*pos - batch->count > INT_MAX) return NULL;
+        id = *pos - batch->count;
+
+        if (batch->show_id) {
+                if (id > batch->show_id) return NULL;
+                id = batch->show_id;
+                injection = idr_find(&ki_registry, id);
+        } else
+                injection = idr_get_next(&ki_registry, &id);
+
+        if (injection) *pos = batch->count + id;
+        return injection;
+}
+
+/*
+ * Sequence file's start iterator. Whole iteration is an RCU read side
+ * section, so it never waits for writers.
  */
 static void *ki_seq_start(struct seq_file *s, loff_t *pos)
+        __acquires(RCU)
 {
-        if (*pos == 0) return SEQ_START_TOKEN;
-        return seq_list_start(&ki_injection_list, *pos - 1);
+        rcu_read_lock();
+        s->private = rcu_dereference(ki_batch);
+        return ki_seq_find(s->private, pos);
 }
 
 /*
@@ -97,18 +271,23 @@ static void *ki_seq_start(struct seq_file *s, loff_t *pos)
  */
 static void *ki_seq_next(struct seq_file *s, void *v, loff_t *pos)
 {
-        if (v == SEQ_START_TOKEN) 
-                return seq_list_start(&ki_injection_list, *pos - 1);
+        struct ki_batch *batch = s->private;
+
+        if (ki_seq_is_status(batch, v))
+                ++*pos;
+        else
+                *pos = batch->count + ((struct ki_injection*)v)->id + 1;
        
-        return seq_list_next(v, &ki_injection_list, pos);
+        return ki_seq_find(batch, pos);
 }
 
 /*
- * We don't need to free anything after iteration
+ * Sequence file's stop iterator
  */
 static void ki_seq_stop(struct seq_file *s, void *v)
+        __releases(RCU)
 {
-
+        rcu_read_unlock();
 }
 
 /*
@@ -116,22 +295,67 @@ static void ki_seq_stop(struct seq_file *s, void *v)
  */
 static int ki_seq_show(struct seq_file *s, void *v)
 {
-        if (v == SEQ_START_TOKEN)
-                seq_printf(s, "%lu: %s\n", ki_pos, ki_msg);
-        else {  
-                long actualcalls;
-                struct ki_injection *injection;
-                injection = list_entry(((struct list_head*)v), 
-                                         struct ki_injection, list);
-                actualcalls = injection->calls - injection->skipped_inj;
-                if (actualcalls < 0) actualcalls = 0;
+        if (ki_seq_is_status(s->private, v)) {
+                struct ki_status *status = v;
+                if (status->id && !status->show)
+                        seq_printf(s, "%lu: %s ID %d\n", status->pos,
+                                   status->msg, status->id);
+                else
+                        seq_printf(s, "%lu: %s\n", status->pos, status->msg);
+        } else {  
+                struct ki_injection *injection = v;
+
+                if (injection->campaign) {
+                        seq_printf(s, "CAMPAIGN %s CALLS %ld/%ld ID %d\n",
+                                   ACCESS_ONCE(injection->finished) ? 
+                                   "FINISHED" : "RUNNING",
+                                   ki_injection_calls(injection),
+                                   injection->campaign,
+                                   injection->id);
+                        return 0;
+                }
+
+                if (injection->profile) {
+                        seq_printf(s, "PROFILE %s SAMPLES %ld ID %d\n",
+                                   ACCESS_ONCE(injection->finished) ? 
+                                   "FINISHED" : "RUNNING",
+                                   ki_injection_calls(injection),
+                                   injection->id);
+                        return 0;
+                }
 
-                seq_printf(s, "TRIGGER 0x%lx (%s+%ld) CALLS %ld/%ld\n", 
+                if (injection->timer_period) {
+                        seq_printf(s, "TIMER %ldns%s CALLS %ld/%ld ID %d\n",
+                                   injection->timer_period,
+                                   injection->flags & KI_FLG_TIMER_PERCPU ?
+                                   " PERCPU" : "",
+                                   ki_injection_calls(injection),
+                                   injection->max_inj,
+                                   injection->id);
+                        return 0;
+                }
+
+                seq_printf(s, "TRIGGER 0x%lx (%s+%ld) CALLS %ld/%ld ID %d", 
                            injection->trigger.addr + injection->trigger_offset,
                            injection->trigger.name ? injection->trigger.name : "?",
                            injection->trigger_offset,
-                           actualcalls,
-                           injection->max_inj);
+                           ki_injection_calls(injection),
+                           injection->max_inj,
+                           injection->id);
+
+                if (injection->flags & KI_FLG_OUTCOME) {
+                        long returned, errors;
+                        u64 latency;
+
+                        ki_injection_outcome(injection, &returned, &errors,
+                                             &latency);
+                        seq_printf(s, " RETURNED %ld ERRORS %ld LATENCY %lluns"
+                                   " MISSED %ld",
+                                   returned, errors, returned ?
+                                   div64_u64(latency, returned) : 0,
+                                   ki_probe_missed(injection));
+                }
+                seq_putc(s, '\n');
         }
 
         return 0;
@@ -168,23 +392,118 @@ static struct file_operations ki_file_ops = {
         .write   = ki_write
 };
 
+/* --- MODULE NOTIFIER ---------------------------------------------------- */
+/*
+ * Disarm injections triggered in or targeting a module which goes away
+ */
+static int ki_module_notify(struct notifier_block *nb, unsigned long action,
+                            void *data)
+{
+        if (action != MODULE_STATE_GOING)
+                return NOTIFY_OK;
+
+        mutex_lock(&ki_mutex);
+        ki_free_module_injections(&ki_registry, data);
+        mutex_unlock(&ki_mutex);
+
+        return NOTIFY_OK;
+}
+
+static struct notifier_block ki_module_nb = {
+        .notifier_call = ki_module_notify
+};
+
 /* --- ENTRY POINT --------------------------------------------------------- */
 static int __init init_kernelinjector(void)
 {
+        /* Injection records must be ready before first injection */
+        if (ki_records_init()) {
+                printk(MODULE_PRINTK_ERR "Couldn't create injection records\n");
+                goto err;
+        }
+
+        /* Records are multicast to netlink listeners as well */
+        if (ki_netlink_init()) {
+                printk(MODULE_PRINTK_ERR "Couldn't register netlink family\n");
+                goto err_records;
+        }
+
+        /* Symbols are cached until their module goes away */
+        if (ki_symcache_init()) {
+                printk(MODULE_PRINTK_ERR "Couldn't create symbol cache\n");
+                goto err_netlink;
+        }
+
+        /* Segments of vmlinux and used modules are tracked */
+        if (ki_segments_init()) {
+                printk(MODULE_PRINTK_ERR "Couldn't create segment table\n");
+                goto err_symcache;
+        }
+
+        /* Kernel text patching is resolved before first injection */
+        ki_poke_init();
+        ki_stats_init();
+
+        /* Injections into unloaded modules are disarmed */
+        if (register_module_notifier(&ki_module_nb)) {
+                printk(MODULE_PRINTK_ERR "Couldn't register module notifier\n");
+                goto err_stats;
+        }
+
         /* Creating proc file for handling commands */
         if (!proc_create(MODULE_NAME_STR, 0666, NULL, &ki_file_ops)) {
                 printk(MODULE_PRINTK_ERR "Couldn't create procfs file\n");
-                return -ENOMEM;
+                goto err_notifier;
+        }
+
+        /* Binary interface goes next to procfs */
+        if (ki_device_init()) {
+                printk(MODULE_PRINTK_ERR "Couldn't register device\n");
+                goto err_proc;
         }
 
         return 0;
+
+err_proc:
+        remove_proc_entry(MODULE_NAME_STR, NULL);
+err_notifier:
+        unregister_module_notifier(&ki_module_nb);
+err_stats:
+        ki_poke_exit();
+        ki_stats_exit();
+        ki_segments_exit();
+err_symcache:
+        ki_symcache_exit();
+err_netlink:
+        ki_netlink_exit();
+err_records:
+        ki_records_exit();
+err:
+        return -ENOMEM;
 }
 
 static void  __exit exit_kernelinjector(void)
 {
-        /* Remove proc entry and all injections */
+        /* Remove device, proc entry and all injections */
+        ki_device_exit();
         remove_proc_entry(MODULE_NAME_STR, NULL);
-        ki_free_injection_list(&ki_injection_list);
+        unregister_module_notifier(&ki_module_nb);
+        mutex_lock(&ki_mutex);
+        ki_free_injections(&ki_registry);
+        ki_set_batch(&ki_no_batch);
+        mutex_unlock(&ki_mutex);
+        idr_destroy(&ki_registry);
+
+        /* Wait for injections and batches freed after grace periods,
+         * injections go through RCU-sched first */
+        rcu_barrier_sched();
+        rcu_barrier();
+        ki_poke_exit();
+        ki_stats_exit();
+        ki_segments_exit();
+        ki_symcache_exit();
+        ki_netlink_exit();
+        ki_records_exit();
 }
 
 module_init(init_kernelinjector);
@@ -22,7 +22,16 @@
 /* --- DEFINES ------------------------------------------------------------- */
 #define MODULE_NAME_STR "kernelinjector"
 #define MODULE_PROC_FILE "/proc/kernelinjector"
+#define MODULE_RECORDS_STR MODULE_NAME_STR "_records"
 #define MODULE_PRINTK_ERR KERN_ERR MODULE_NAME_STR ": "
 #define MODULE_PRINTK_DBG KERN_DEBUG MODULE_NAME_STR ": "
 
+struct ki_injection;
+struct ki_status;
+
+/* --- REGISTRY FUNCTIONS -------------------------------------------------- */
+bool ki_registry_execute(struct ki_injection **injections, size_t count,
+                         struct ki_status *status);
+struct ki_injection *ki_registry_find(int id);
+
 #endif /*KI_KINJECTOR_H*/
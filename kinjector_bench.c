@@ -0,0 +1,256 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+/*
+ * Companion module measuring trigger overhead. Kernel threads bound to
+ * CPUs call ki_bench_target in a loop, triggers of kernelinjector are armed
+ * on it by user/kinjector_bench.sh. Writing number of threads to
+ * /proc/kinjector_bench runs one measurement, reading it shows the result.
+ */
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/math64.h>
+#include <linux/cpumask.h>
+
+MODULE_AUTHOR("Przemysław Lenart <przemek.lenart@gmail.com>");
+MODULE_DESCRIPTION("Linux kernel injector benchmark");
+MODULE_VERSION("0.2");
+MODULE_LICENSE("GPL");
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_BENCH_NAME  "kinjector_bench"
+#define KI_BENCH_BATCH 64       /* Calls between clock reads */
+#define KI_BENCH_PRINTK_ERR KERN_ERR KI_BENCH_NAME ": "
+
+/* --- STRUCTURES ---------------------------------------------------------- */
+/*
+ * State of one calling thread
+ */
+struct ki_bench_thread
+{
+        struct task_struct *task;
+        u64                 calls;
+        u64                 busy_ns;    /* Time spent in calls */
+        u64                 elapsed_ns; /* Time from start to stop */
+};
+
+/*
+ * Result of the last measurement
+ */
+struct ki_bench_result
+{
+        unsigned int threads;
+        u64          calls;
+        u64          ns_per_call;
+        u64          calls_per_sec;
+};
+
+/* --- GLOBALS ------------------------------------------------------------- */
+static unsigned int duration_ms = 1000;
+module_param(duration_ms, uint, 0644);
+MODULE_PARM_DESC(duration_ms, "Length of one measurement in milliseconds");
+
+static unsigned long rate;
+module_param(rate, ulong, 0644);
+MODULE_PARM_DESC(rate, "Calls per second of every thread, 0 for no limit");
+
+static DEFINE_MUTEX(ki_bench_mutex);
+static struct ki_bench_result ki_bench_last;
+static unsigned long ki_bench_sink;
+
+/* Target of INJECT_INTO, DEBUG injections only read it */
+unsigned long ki_bench_data;
+
+/* --- TARGET -------------------------------------------------------------- */
+/*
+ * Function triggers are armed on. It's global and never inlined, so its
+ * symbol has no compiler suffix and every call enters it.
+ */
+noinline unsigned long ki_bench_target(unsigned long x)
+{
+        return x + ACCESS_ONCE(ki_bench_data);
+}
+
+/* --- THREADS ------------------------------------------------------------- */
+/*
+ * Call target in batches until stopped. With rate limit every batch is
+ * paced, time spent sleeping is not counted as busy.
+ */
+static int ki_bench_thread(void *data)
+{
+        unsigned int i;
+        unsigned long sum = 0;
+        struct ki_bench_thread *thread = data;
+        u64 now, start = local_clock(), next = start, step = 0;
+
+        if (rate)
+                step = div64_u64((u64)NSEC_PER_SEC * KI_BENCH_BATCH, rate);
+
+        while (!kthread_should_stop()) {
+                now = local_clock();
+                for (i = 0; i < KI_BENCH_BATCH; ++i)
+                        sum += ki_bench_target(i);
+                thread->busy_ns += local_clock() - now;
+                thread->calls += KI_BENCH_BATCH;
+
+                if (step) {
+                        next += step;
+                        now = local_clock();
+                        if (next > now + NSEC_PER_USEC * 10)
+                                usleep_range(div_u64(next - now, 
+                                                     NSEC_PER_USEC),
+                                             div_u64(next - now, 
+                                                     NSEC_PER_USEC) + 10);
+                        else
+                                cond_resched();
+                } else
+                        cond_resched();
+        }
+
+        thread->elapsed_ns = local_clock() - start;
+        ACCESS_ONCE(ki_bench_sink) = sum;
+        return 0;
+}
+
+/*
+ * Run one measurement with threads bound to first online CPUs.
+ * Returns 0 on success.
+ */
+static int ki_bench_run(unsigned int count)
+{
+        int cpu, ret = 0;
+        unsigned int i, started = 0;
+        u64 calls = 0, busy_ns = 0, elapsed_ns = 0;
+        struct ki_bench_thread *threads;
+
+        threads = kcalloc(count, sizeof(*threads), GFP_KERNEL);
+        if (!threads) return -ENOMEM;
+
+        for_each_online_cpu(cpu) {
+                struct task_struct *task;
+
+                if (started == count) break;
+                task = kthread_create(ki_bench_thread, &threads[started],
+                                      KI_BENCH_NAME "/%d", cpu);
+                if (IS_ERR(task)) {
+                        ret = PTR_ERR(task);
+                        break;
+                }
+                kthread_bind(task, cpu);
+                threads[started++].task = task;
+        }
+
+        /* Threads start together */
+        for (i = 0; i < started; ++i)
+                wake_up_process(threads[i].task);
+        if (!ret) msleep(duration_ms);
+        for (i = 0; i < started; ++i)
+                kthread_stop(threads[i].task);
+
+        for (i = 0; i < started; ++i) {
+                calls += threads[i].calls;
+                busy_ns += threads[i].busy_ns;
+                elapsed_ns = max(elapsed_ns, threads[i].elapsed_ns);
+        }
+        kfree(threads);
+        if (ret) return ret;
+
+        ki_bench_last.threads = started;
+        ki_bench_last.calls = calls;
+        ki_bench_last.ns_per_call = calls ? div64_u64(busy_ns, calls) : 0;
+        ki_bench_last.calls_per_sec = elapsed_ns ? 
+                div64_u64(calls * NSEC_PER_SEC, elapsed_ns) : 0;
+        return 0;
+}
+
+/* --- PROCFS -------------------------------------------------------------- */
+/*
+ * Run a measurement with number of threads written by user, the number
+ * is limited to online CPUs
+ */
+static ssize_t ki_bench_write(struct file *filp, const char __user *buffer,
+                              size_t len, loff_t *f_pos)
+{
+        int ret;
+        unsigned int count;
+
+        ret = kstrtouint_from_user(buffer, len, 10, &count);
+        if (ret) return ret;
+        if (!count || count > num_online_cpus()) return -EINVAL;
+
+        if (mutex_lock_interruptible(&ki_bench_mutex)) return -EINTR;
+        ret = ki_bench_run(count);
+        mutex_unlock(&ki_bench_mutex);
+
+        return ret ? ret : len;
+}
+
+/*
+ * Show result of the last measurement
+ */
+static int ki_bench_show(struct seq_file *s, void *v)
+{
+        mutex_lock(&ki_bench_mutex);
+        seq_printf(s, "THREADS %u CALLS %llu NS_PER_CALL %llu "
+                   "CALLS_PER_SEC %llu\n", ki_bench_last.threads,
+                   ki_bench_last.calls, ki_bench_last.ns_per_call,
+                   ki_bench_last.calls_per_sec);
+        mutex_unlock(&ki_bench_mutex);
+        return 0;
+}
+
+static int ki_bench_open(struct inode *inode, struct file *file)
+{
+        return single_open(file, ki_bench_show, NULL);
+}
+
+static struct file_operations ki_bench_file_ops = {
+        .owner   = THIS_MODULE,
+        .open    = ki_bench_open,
+        .read    = seq_read,
+        .llseek  = seq_lseek,
+        .release = single_release,
+        .write   = ki_bench_write
+};
+
+/* --- ENTRY POINT --------------------------------------------------------- */
+static int __init init_kinjector_bench(void)
+{
+        if (!proc_create(KI_BENCH_NAME, 0600, NULL, &ki_bench_file_ops)) {
+                printk(KI_BENCH_PRINTK_ERR "Couldn't create procfs file\n");
+                return -ENOMEM;
+        }
+
+        return 0;
+}
+
+static void __exit exit_kinjector_bench(void)
+{
+        remove_proc_entry(KI_BENCH_NAME, NULL);
+}
+
+module_init(init_kinjector_bench);
+module_exit(exit_kinjector_bench);
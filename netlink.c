@@ -0,0 +1,230 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/irq_work.h>
+#include <linux/workqueue.h>
+#include <net/genetlink.h>
+#include <net/net_namespace.h>
+#include "netlink.h"
+#include "records.h"
+#include "ring.h"
+#include "execute.h"
+#include "kinjector.h"
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_NL_RING_SIZE 256 /* Records per CPU, must be a power of two */
+
+/* --- GLOBALS ------------------------------------------------------------- */
+static struct genl_multicast_group ki_nl_groups[] = {
+        { .name = KI_NL_GROUP_NAME }
+};
+
+static struct genl_family ki_nl_family = {
+        .id      = GENL_ID_GENERATE,
+        .name    = KI_NL_FAMILY_NAME,
+        .version = KI_NL_VERSION,
+        .maxattr = KI_NL_A_MAX
+};
+
+static DEFINE_PER_CPU(struct ki_ring, ki_nl_rings);
+static void ki_nl_send(struct work_struct *work);
+static DECLARE_WORK(ki_nl_work, ki_nl_send);
+static bool ki_nl_ready;    /* Family is registered and rings allocated */
+
+/* --- SENDING ------------------------------------------------------------- */
+/*
+ * Check if anybody listens to the events group
+ */
+static bool ki_nl_listeners(void)
+{
+        return netlink_has_listeners(init_net.genl_sock,
+                                     ki_nl_family.mcgrp_offset);
+}
+
+/*
+ * Multicast one record as KI_NL_C_INJECTION message
+ */
+static void ki_nl_send_record(const struct ki_record *rec)
+{
+        void *hdr;
+        struct sk_buff *skb;
+
+        skb = genlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
+        if (!skb) return;
+
+        hdr = genlmsg_put(skb, 0, 0, &ki_nl_family, 0, KI_NL_C_INJECTION);
+        if (!hdr ||
+            nla_put_u64(skb, KI_NL_A_TIMESTAMP, rec->timestamp) ||
+            nla_put_u64(skb, KI_NL_A_TRIGGER, rec->trigger) ||
+            nla_put_u64(skb, KI_NL_A_ADDR, rec->addr) ||
+            nla_put_u64(skb, KI_NL_A_MASK, rec->mask) ||
+            nla_put_u32(skb, KI_NL_A_ID, rec->id) ||
+            nla_put_u32(skb, KI_NL_A_CPU, rec->cpu) ||
+            nla_put_u32(skb, KI_NL_A_TYPE, rec->type) ||
+            nla_put_u32(skb, KI_NL_A_BIT, rec->bit) ||
+            nla_put_u32(skb, KI_NL_A_REG, rec->reg) ||
+            nla_put_u32(skb, KI_NL_A_SIZE, rec->size) ||
+            nla_put_u32(skb, KI_NL_A_FAULT, rec->fault) ||
+            nla_put_u64(skb, KI_NL_A_HIT, rec->hit) ||
+            nla_put_u64(skb, KI_NL_A_OFFSET, rec->offset)) {
+                nlmsg_free(skb);
+                return;
+        }
+
+        genlmsg_end(skb, hdr);
+        genlmsg_multicast(&ki_nl_family, skb, 0, 0, GFP_KERNEL);
+}
+
+/*
+ * Drain rings of all CPUs. Runs in process context, so records are built
+ * and sent outside of trigger handlers.
+ */
+static void ki_nl_send(struct work_struct *work)
+{
+        int cpu;
+        bool listeners = ki_nl_listeners();
+
+        for_each_possible_cpu(cpu) {
+                struct ki_ring *ring = per_cpu_ptr(&ki_nl_rings, cpu);
+                struct ki_record rec;
+                unsigned long n;
+
+                /* Records are taken even without listeners, dropped ones
+                 * are reported the same way as in records file. One ring
+                 * full is sent at a time, records queued meanwhile kick
+                 * the work again. */
+                for (n = 0; n <= ring->size &&
+                            ki_ring_pop(ring, cpu, &rec); ++n) {
+                        ki_ring_release(ring, &rec);
+                        if (listeners) ki_nl_send_record(&rec);
+                }
+        }
+}
+
+/*
+ * Schedule sending from interrupt context
+ */
+static void ki_nl_kick(struct irq_work *work)
+{
+        schedule_work(&ki_nl_work);
+}
+
+static DEFINE_PER_CPU(struct irq_work, ki_nl_irq_work) = {
+        .func = ki_nl_kick
+};
+
+/* --- FUNCTIONS ----------------------------------------------------------- */
+/*
+ * Queue record for sending if anybody listens. Must be called with
+ * interrupts disabled, record is dropped when ring is full or in NMI and
+ * counted as lost, which is reported with the next sent record.
+ */
+void ki_netlink_record(const struct ki_record *rec)
+{
+        if (!ki_nl_ready || !ki_nl_listeners()) return;
+
+        /* Sending of the full ring is already queued */
+        if (!ki_ring_push(this_cpu_ptr(&ki_nl_rings), rec)) return;
+
+        /* Workqueue can't be used from NMI or with runqueue locks held */
+        irq_work_queue(this_cpu_ptr(&ki_nl_irq_work));
+}
+
+/*
+ * Multicast results of an executed batch as KI_NL_C_RESULT messages.
+ * Called in process context.
+ */
+void ki_netlink_status(const struct ki_status *status, size_t count)
+{
+        size_t i;
+
+        if (!ki_nl_ready || !ki_nl_listeners()) return;
+
+        for (i = 0; i < count; ++i) {
+                void *hdr;
+                struct sk_buff *skb;
+
+                skb = genlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
+                if (!skb) return;
+
+                hdr = genlmsg_put(skb, 0, 0, &ki_nl_family, 0, 
+                                  KI_NL_C_RESULT);
+                if (!hdr ||
+                    nla_put_u32(skb, KI_NL_A_POS, status[i].pos) ||
+                    nla_put_u32(skb, KI_NL_A_ID, status[i].id) ||
+                    nla_put_string(skb, KI_NL_A_MSG, status[i].msg)) {
+                        nlmsg_free(skb);
+                        return;
+                }
+
+                genlmsg_end(skb, hdr);
+                genlmsg_multicast(&ki_nl_family, skb, 0, 0, GFP_KERNEL);
+        }
+}
+
+/*
+ * Allocate rings and register generic netlink family
+ * Returns 0 on success.
+ */
+int ki_netlink_init(void)
+{
+        int cpu;
+
+        for_each_possible_cpu(cpu) {
+                struct ki_ring *ring = per_cpu_ptr(&ki_nl_rings, cpu);
+                ring->size = KI_NL_RING_SIZE;
+                ring->buf = kzalloc_node(KI_NL_RING_SIZE * sizeof(*ring->buf),
+                                         GFP_KERNEL, cpu_to_node(cpu));
+                if (!ring->buf) goto fail;
+        }
+
+        /* Family only multicasts, it has no operations */
+        if (genl_register_family_with_mcgrps(&ki_nl_family, ki_nl_groups))
+                goto fail;
+
+        ki_nl_ready = true;
+        return 0;
+
+fail:
+        for_each_possible_cpu(cpu) {
+                kfree(per_cpu_ptr(&ki_nl_rings, cpu)->buf);
+                per_cpu_ptr(&ki_nl_rings, cpu)->buf = NULL;
+        }
+        return -ENOMEM;
+}
+
+/*
+ * Unregister family after pending records are sent and free rings.
+ * Called after all injections are gone.
+ */
+void ki_netlink_exit(void)
+{
+        int cpu;
+
+        ki_nl_ready = false;
+        for_each_possible_cpu(cpu)
+                irq_work_sync(per_cpu_ptr(&ki_nl_irq_work, cpu));
+        flush_work(&ki_nl_work);
+
+        genl_unregister_family(&ki_nl_family);
+        for_each_possible_cpu(cpu)
+                kfree(per_cpu_ptr(&ki_nl_rings, cpu)->buf);
+}
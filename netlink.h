@@ -0,0 +1,76 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_NETLINK_H
+#define KI_NETLINK_H
+
+/* --- NETLINK DEFINITIONS ------------------------------------------------- */
+/*
+ * Generic netlink family multicasting injection events. Every executed
+ * injection is sent as KI_NL_C_INJECTION with the same fields as struct
+ * ki_record, every executed command as KI_NL_C_RESULT with the same fields
+ * as its /proc/kernelinjector status line.
+ */
+#define KI_NL_FAMILY_NAME "kernelinjector"
+#define KI_NL_GROUP_NAME  "events"
+#define KI_NL_VERSION     1
+
+enum ki_nl_cmd_e
+{
+        KI_NL_C_UNSPEC    = 0,
+        KI_NL_C_INJECTION = 1,  /* One record of an injection */
+        KI_NL_C_RESULT    = 2   /* Result of one command */
+};
+
+enum ki_nl_attr_e
+{
+        KI_NL_A_UNSPEC    = 0,
+        KI_NL_A_TIMESTAMP = 1,  /* u64, local_clock() in nanoseconds */
+        KI_NL_A_TRIGGER   = 2,  /* u64, trigger address, 0 if immediate */
+        KI_NL_A_ADDR      = 3,  /* u64, address of modified byte or word */
+        KI_NL_A_MASK      = 4,  /* u64, changed bits of the word */
+        KI_NL_A_ID        = 5,  /* u32, injection id */
+        KI_NL_A_CPU       = 6,  /* u32 */
+        KI_NL_A_TYPE      = 7,  /* u32, enum ki_record_type_e */
+        KI_NL_A_BIT       = 8,  /* u32, lowest changed bit number */
+        KI_NL_A_REG       = 9,  /* u32, byte offset in pt_regs */
+        KI_NL_A_SIZE      = 10, /* u32, size of modified word in bytes */
+        KI_NL_A_FAULT     = 11, /* u32, enum ki_fault_e */
+        KI_NL_A_POS       = 12, /* u32, column of command result */
+        KI_NL_A_MSG       = 13, /* string, command result */
+        KI_NL_A_HIT       = 14, /* u64, hit ordinal of the CPU */
+        KI_NL_A_OFFSET    = 15, /* u64, offset from start of the type */
+        KI_NL_A_MAX       = KI_NL_A_OFFSET
+};
+
+#ifdef __KERNEL__
+
+#include <linux/types.h>
+
+struct ki_record;
+struct ki_status;
+
+/* --- NETLINK FUNCTIONS --------------------------------------------------- */
+int ki_netlink_init(void);
+void ki_netlink_exit(void);
+void ki_netlink_record(const struct ki_record *rec);
+void ki_netlink_status(const struct ki_status *status, size_t count);
+
+#endif /*__KERNEL__*/
+
+#endif /*KI_NETLINK_H*/
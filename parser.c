@@ -19,28 +19,80 @@
 #include <linux/ctype.h>
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/math64.h>
 #include "parser.h"
 #include "injection.h"
-#include "kinjector.h"
+#include "records.h"
 
 /* --- KEYWORDS ------------------------------------------------------------ */
 #define KEYWORD(x) (x), sizeof (x) - 1
+static const char ki_key_atomic[]             = "ATOMIC";
 static const char ki_key_bitflip[]            = "BITFLIP";
+static const char ki_key_bss[]                = "BSS";
+static const char ki_key_campaign[]           = "CAMPAIGN";
 static const char ki_key_clear[]              = "CLEAR";
 static const char ki_key_code[]               = "CODE";
 static const char ki_key_data[]               = "DATA";
+static const char ki_key_init[]               = "INIT";
 static const char ki_key_inject_into[]        = "INJECT_INTO";
 static const char ki_key_inject_offset[]      = "INJECT_OFFSET";
+static const char ki_key_interval[]           = "INTERVAL";
 static const char ki_key_max_injections[]     = "MAX_INJECTIONS";
 static const char ki_key_module[]             = "MODULE";
+static const char ki_key_outcome[]            = "OUTCOME";
+static const char ki_key_percpu[]             = "PERCPU";
 static const char ki_key_regs[]               = "REGS";
+static const char ki_key_remove[]             = "REMOVE";
+static const char ki_key_replay[]             = "REPLAY";
 static const char ki_key_rodata[]             = "RODATA";
 static const char ki_key_skipped_injections[] = "SKIPPED_INJECTIONS";
 static const char ki_key_stack[]              = "STACK";
 static const char ki_key_trigger[]            = "TRIGGER";
 static const char ki_key_trigger_offset[]     = "TRIGGER_OFFSET";
+static const char ki_key_trigger_mode[]       = "TRIGGER_MODE";
+static const char ki_key_trigger_timer[]      = "TRIGGER_TIMER";
+static const char ki_key_timer_jitter[]       = "TIMER_JITTER";
+static const char ki_key_timer_percpu[]       = "TIMER_PERCPU";
+static const char ki_key_auto[]               = "AUTO";
+static const char ki_key_kprobe[]             = "KPROBE";
+static const char ki_key_ftrace[]             = "FTRACE";
 static const char ki_key_debug[]              = "DEBUG";
+static const char ki_key_duration[]           = "DURATION";
+static const char ki_key_every[]              = "EVERY";
+static const char ki_key_fault[]              = "FAULT";
+static const char ki_key_bits[]               = "BITS";
+static const char ki_key_burst[]              = "BURST";
+static const char ki_key_xor[]                = "XOR";
+static const char ki_key_stuck0[]             = "STUCK0";
+static const char ki_key_stuck1[]             = "STUCK1";
+static const char ki_key_random[]             = "RANDOM";
+static const char ki_key_poisson[]            = "POISSON";
+static const char ki_key_probability[]        = "PROBABILITY";
+static const char ki_key_profile[]            = "PROFILE";
+static const char ki_key_hot[]                = "HOT";
 static const char ki_key_seed[]               = "SEED";
+static const char ki_key_show[]               = "SHOW";
+static const char ki_key_target[]             = "TARGET";
+
+/*
+ * Record types accepted by REPLAY
+ */
+static const struct
+{
+        const char            *key;
+        size_t                 len;
+        enum ki_record_type_e  type;
+} ki_replay_types[] = {
+        { KEYWORD(ki_key_target), KI_REC_TARGET },
+        { KEYWORD(ki_key_stack),  KI_REC_STACK  },
+        { KEYWORD(ki_key_regs),   KI_REC_REGS   },
+        { KEYWORD(ki_key_data),   KI_REC_DATA   },
+        { KEYWORD(ki_key_rodata), KI_REC_RODATA },
+        { KEYWORD(ki_key_code),   KI_REC_CODE   },
+        { KEYWORD(ki_key_bss),    KI_REC_BSS    },
+        { KEYWORD(ki_key_init),   KI_REC_INIT   },
+        { KEYWORD(ki_key_percpu), KI_REC_PERCPU }
+};
 
 /* --- FUNCTIONS ----------------------------------------------------------- */
 /*
@@ -51,7 +103,6 @@ static const char ki_key_seed[]               = "SEED";
 static bool ki_parse_hex(char* buffer, size_t *pos, unsigned long *hex)
 {
         size_t startpos = *pos;
-        printk(MODULE_PRINTK_DBG "Parse hex: %s", buffer + *pos);
 
         /* Find end of a string */
         while (!iscntrl(buffer[*pos])) {
@@ -82,7 +133,6 @@ static bool ki_parse_hex(char* buffer, size_t *pos, unsigned long *hex)
 static bool ki_parse_dec(char* buffer, size_t *pos, long *dec)
 {
         size_t startpos = *pos;
-        printk(MODULE_PRINTK_DBG "Parse dec: %s", buffer + *pos);
 
         /* Find end of a string */
         while (!iscntrl(buffer[*pos])) {
@@ -104,6 +154,38 @@ static bool ki_parse_dec(char* buffer, size_t *pos, long *dec)
         return false;
 }
 
+/*
+ * Parse decimal fraction such as 0.001 into fixed point value with 32
+ * fractional bits. Up to 9 fractional digits are used.
+ * Returns true on success.
+ */
+static bool ki_parse_fraction(const char *buffer, size_t *pos, u64 *value)
+{
+        size_t startpos = *pos;
+        u64 integer = 0, fraction = 0, scale = 1000000000ULL;
+
+        while (isdigit(buffer[*pos]) && integer <= U32_MAX) {
+                integer = integer * 10 + (buffer[*pos] - '0');
+                ++*pos;
+        }
+        if (*pos == startpos || integer > U32_MAX) return false;
+
+        if (buffer[*pos] == '.') {
+                ++*pos;
+                if (!isdigit(buffer[*pos])) return false;
+                while (isdigit(buffer[*pos])) {
+                        if (scale > 1) {
+                                scale /= 10;
+                                fraction += (buffer[*pos] - '0') * scale;
+                        }
+                        ++*pos;
+                }
+        }
+
+        *value = (integer << 32) + div_u64(fraction << 32, 1000000000U);
+        return true;
+}
+
 /*
  * Parse symbol.
  * Returns true on success.
@@ -111,7 +193,6 @@ static bool ki_parse_dec(char* buffer, size_t *pos, long *dec)
 static bool ki_parse_sym(const char *buffer, size_t *pos, char **result)
 {
         size_t startpos = *pos;
-        printk(MODULE_PRINTK_DBG "Parse sym: %s", buffer + *pos);
 
         /* Check if string is correct and find it's end */
         while (!iscntrl(buffer[*pos]) && buffer[*pos] != ' ') {
@@ -137,7 +218,6 @@ static bool ki_parse_sym(const char *buffer, size_t *pos, char **result)
  */
 static bool ki_parse_hex_prefix(const char *buffer, size_t *pos)
 {
-        printk(MODULE_PRINTK_DBG "Parse hex_prefix: %s", buffer + *pos);
         if (buffer[*pos] == '0' && buffer[*pos+1] == 'x') {
                 *pos += 2;
                 return true;
@@ -154,7 +234,6 @@ static bool ki_parse_sym_or_addr(char *buffer, size_t *pos,
                           struct ki_symbol *symbol)
 {
         size_t startpos = *pos;
-        printk(MODULE_PRINTK_DBG "Parse sym_or_addr: %s", buffer + *pos);
 
         /* If we have hexadecimal prefix, it's address */
         if (ki_parse_hex_prefix(buffer, &startpos)) {
@@ -188,6 +267,16 @@ static bool ki_parse_skip_space(const char *buffer, size_t *pos)
         return true;
 }
 
+/*
+ * Skips one colon separating fields of an argument
+ */
+static bool ki_parse_skip_colon(const char *buffer, size_t *pos)
+{
+        if (buffer[*pos] != ':') return false;
+        ++*pos;
+        return true;
+}
+
 /*
  * Parse BITFLIP keyword
  * Returns true on success.
@@ -206,7 +295,8 @@ static bool ki_parse_bitflip(char *buffer, size_t len, size_t *pos,
                 return false;
         }
 
-        if (!ki_parse_dec(buffer, pos, &injection->bitflip)) {
+        if (!ki_parse_dec(buffer, pos, &injection->bitflip) ||
+            injection->bitflip <= 0) {
                 *msg = "Wrong BITFLIP argument";
                 return false;
         }
@@ -214,6 +304,66 @@ static bool ki_parse_bitflip(char *buffer, size_t len, size_t *pos,
         return true;
 }
 
+/*
+ * Parse ATOMIC keyword.
+ * Returns true on success.
+ */
+static bool ki_parse_atomic(const char *buffer, size_t len, size_t *pos,
+                            char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_atomic))) {
+                *msg = "ATOMIC keyword expected";
+                return false;
+        }
+
+        injection->flags |= KI_FLG_ATOMIC;
+        return true;
+}
+
+/*
+ * Parse BSS keyword.
+ * Returns true on success.
+ */
+static bool ki_parse_bss(const char *buffer, size_t len, size_t *pos,
+                         char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_bss))) {
+                *msg = "BSS keyword expected";
+                return false;
+        }
+        
+        injection->flags |= KI_FLG_BSS;
+        return true;
+}
+
+/*
+ * Parse CAMPAIGN keyword
+ * Returns true on success.
+ */
+static bool ki_parse_campaign(char *buffer, size_t len, size_t *pos,
+                              char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_campaign))) {
+                *msg = "CAMPAIGN keyword expected";
+                return false;
+        }
+        
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "CAMPAIGN number of injections expected";
+                return false;
+        }
+
+        if (!ki_parse_dec(buffer, pos, &injection->campaign)) {
+                *msg = "Wrong CAMPAIGN argument";
+                return false;
+        }
+
+        return true;
+}
+
 /*
  * Parse CLEAR keyword.
  * Returns true on success.
@@ -232,12 +382,14 @@ static bool ki_parse_clear(const char *buffer, size_t len, size_t *pos,
 }
 
 /*
- * Parse CODE keyword.
+ * Parse CODE keyword with optional HOT mode.
  * Returns true on success.
  */
 static bool ki_parse_code(const char *buffer, size_t len, size_t *pos,
                           char** msg, struct ki_injection *injection)
 {
+        size_t next;
+
         if (!ki_parse_keyword(buffer, len, pos, 
                              KEYWORD(ki_key_code))) {
                 *msg = "CODE keyword expected";
@@ -245,6 +397,14 @@ static bool ki_parse_code(const char *buffer, size_t len, size_t *pos,
         }
         
         injection->flags |= KI_FLG_CODE;
+
+        next = *pos;
+        if (ki_parse_skip_space(buffer, &next) &&
+            ki_parse_keyword(buffer, len, &next, KEYWORD(ki_key_hot))) {
+                injection->flags |= KI_FLG_HOT;
+                *pos = next;
+        }
+
         return true;
 }
 
@@ -282,6 +442,150 @@ static bool ki_parse_debug(const char *buffer, size_t len, size_t *pos,
         return true;
 }
 
+/*
+ * Parse DURATION keyword
+ * Returns true on success.
+ */
+static bool ki_parse_duration(char *buffer, size_t len, size_t *pos,
+                              char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_duration))) {
+                *msg = "DURATION keyword expected";
+                return false;
+        }
+        
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "DURATION number of milliseconds expected";
+                return false;
+        }
+
+        if (!ki_parse_dec(buffer, pos, &injection->duration)) {
+                *msg = "Wrong DURATION argument";
+                return false;
+        }
+
+        return true;
+}
+
+/*
+ * Parse EVERY keyword
+ * Returns true on success.
+ */
+static bool ki_parse_every(char *buffer, size_t len, size_t *pos,
+                           char** msg, struct ki_injection *injection)
+{
+        long every;
+
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_every))) {
+                *msg = "EVERY keyword expected";
+                return false;
+        }
+        
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "EVERY number of hits expected";
+                return false;
+        }
+
+        if (injection->sched) {
+                *msg = "PROBABILITY, EVERY, POISSON already specified";
+                return false;
+        }
+
+        if (!ki_parse_dec(buffer, pos, &every) || every <= 0) {
+                *msg = "Wrong EVERY argument";
+                return false;
+        }
+
+        injection->sched = KI_SCHED_EVERY;
+        injection->sched_arg = every;
+        return true;
+}
+
+/*
+ * Parse FAULT keyword. BITS and BURST take a decimal number of bits, XOR,
+ * STUCK0 and STUCK1 take a hexadecimal mask.
+ * Returns true on success.
+ */
+static bool ki_parse_fault(char *buffer, size_t len, size_t *pos,
+                           char** msg, struct ki_injection *injection)
+{
+        long bits;
+        unsigned long mask;
+
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_fault))) {
+                *msg = "FAULT keyword expected";
+                return false;
+        }
+        
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "FAULT BITS, BURST, XOR, STUCK0, STUCK1 or RANDOM "
+                       "expected";
+                return false;
+        }
+
+        if (ki_parse_keyword(buffer, len, pos, KEYWORD(ki_key_bits)))
+                injection->fault = KI_FAULT_BITS;
+        else if (ki_parse_keyword(buffer, len, pos, KEYWORD(ki_key_burst)))
+                injection->fault = KI_FAULT_BURST;
+        else if (ki_parse_keyword(buffer, len, pos, KEYWORD(ki_key_xor)))
+                injection->fault = KI_FAULT_XOR;
+        else if (ki_parse_keyword(buffer, len, pos, KEYWORD(ki_key_stuck0)))
+                injection->fault = KI_FAULT_STUCK0;
+        else if (ki_parse_keyword(buffer, len, pos, KEYWORD(ki_key_stuck1)))
+                injection->fault = KI_FAULT_STUCK1;
+        else if (ki_parse_keyword(buffer, len, pos, KEYWORD(ki_key_random))) {
+                injection->fault = KI_FAULT_RANDOM;
+                return true;
+        } else {
+                *msg = "Wrong FAULT argument";
+                return false;
+        }
+
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "FAULT number of bits or mask expected";
+                return false;
+        }
+
+        if (injection->fault == KI_FAULT_BITS || 
+            injection->fault == KI_FAULT_BURST) {
+                if (!ki_parse_dec(buffer, pos, &bits) || 
+                    bits < 1 || bits > 64) {
+                        *msg = "Wrong FAULT number of bits";
+                        return false;
+                }
+                injection->fault_arg = bits;
+                return true;
+        }
+
+        if (!ki_parse_hex_prefix(buffer, pos) ||
+            !ki_parse_hex(buffer, pos, &mask) || !mask) {
+                *msg = "Wrong FAULT mask";
+                return false;
+        }
+        injection->fault_arg = mask;
+        return true;
+}
+
+/*
+ * Parse INIT keyword.
+ * Returns true on success.
+ */
+static bool ki_parse_init(const char *buffer, size_t len, size_t *pos,
+                          char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_init))) {
+                *msg = "INIT keyword expected";
+                return false;
+        }
+        
+        injection->flags |= KI_FLG_INIT;
+        return true;
+}
+
 /*
  * Parse INJECT_INTO keyword
  * Returns true on success.
@@ -339,6 +643,32 @@ static bool ki_parse_inject_offset(char *buffer, size_t len, size_t *pos,
         return true;
 }
 
+/*
+ * Parse INTERVAL keyword
+ * Returns true on success.
+ */
+static bool ki_parse_interval(char *buffer, size_t len, size_t *pos,
+                              char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_interval))) {
+                *msg = "INTERVAL keyword expected";
+                return false;
+        }
+        
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "INTERVAL number of microseconds expected";
+                return false;
+        }
+
+        if (!ki_parse_dec(buffer, pos, &injection->interval)) {
+                *msg = "Wrong INTERVAL argument";
+                return false;
+        }
+
+        return true;
+}
+
 /*
  * Parse MAX_INJECTIONS keyword
  * Returns true on success.
@@ -396,6 +726,133 @@ static bool ki_parse_module(const char *buffer, size_t len, size_t *pos,
         return true;
 }
 
+/*
+ * Parse OUTCOME keyword.
+ * Returns true on success.
+ */
+static bool ki_parse_outcome(const char *buffer, size_t len, size_t *pos,
+                             char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_outcome))) {
+                *msg = "OUTCOME keyword expected";
+                return false;
+        }
+        
+        injection->flags |= KI_FLG_OUTCOME;
+        return true;
+}
+
+/*
+ * Parse PERCPU keyword.
+ * Returns true on success.
+ */
+static bool ki_parse_percpu(const char *buffer, size_t len, size_t *pos,
+                            char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_percpu))) {
+                *msg = "PERCPU keyword expected";
+                return false;
+        }
+        
+        injection->flags |= KI_FLG_PERCPU;
+        return true;
+}
+
+/*
+ * Parse POISSON keyword
+ * Returns true on success.
+ */
+static bool ki_parse_poisson(char *buffer, size_t len, size_t *pos,
+                             char** msg, struct ki_injection *injection)
+{
+        long mean;
+
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_poisson))) {
+                *msg = "POISSON keyword expected";
+                return false;
+        }
+        
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "POISSON mean number of hits expected";
+                return false;
+        }
+
+        if (injection->sched) {
+                *msg = "PROBABILITY, EVERY, POISSON already specified";
+                return false;
+        }
+
+        if (!ki_parse_dec(buffer, pos, &mean) || mean <= 0) {
+                *msg = "Wrong POISSON argument";
+                return false;
+        }
+
+        injection->sched = KI_SCHED_POISSON;
+        injection->sched_arg = mean;
+        return true;
+}
+
+/*
+ * Parse PROBABILITY keyword
+ * Returns true on success.
+ */
+static bool ki_parse_probability(char *buffer, size_t len, size_t *pos,
+                                 char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_probability))) {
+                *msg = "PROBABILITY keyword expected";
+                return false;
+        }
+        
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "PROBABILITY value expected";
+                return false;
+        }
+
+        if (injection->sched) {
+                *msg = "PROBABILITY, EVERY, POISSON already specified";
+                return false;
+        }
+
+        if (!ki_parse_fraction(buffer, pos, &injection->sched_arg)) {
+                *msg = "Wrong PROBABILITY argument";
+                return false;
+        }
+
+        injection->sched = KI_SCHED_PROBABILITY;
+        return true;
+}
+
+/*
+ * Parse PROFILE keyword
+ * Returns true on success.
+ */
+static bool ki_parse_profile(char *buffer, size_t len, size_t *pos,
+                             char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_profile))) {
+                *msg = "PROFILE keyword expected";
+                return false;
+        }
+        
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "PROFILE number of milliseconds expected";
+                return false;
+        }
+
+        if (!ki_parse_dec(buffer, pos, &injection->profile)) {
+                *msg = "Wrong PROFILE argument";
+                return false;
+        }
+
+        return true;
+}
+
 /*
  * Parse REGS keyword.
  * Returns true on success.
@@ -413,6 +870,122 @@ static bool ki_parse_regs(const char *buffer, size_t len, size_t *pos,
         return true;
 }
 
+/*
+ * Parse REMOVE keyword
+ * Returns true on success.
+ */
+static bool ki_parse_remove(char *buffer, size_t len, size_t *pos,
+                            char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_remove))) {
+                *msg = "REMOVE keyword expected";
+                return false;
+        }
+        
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "REMOVE injection id expected";
+                return false;
+        }
+
+        if (!ki_parse_dec(buffer, pos, &injection->ref_id)) {
+                *msg = "Wrong REMOVE argument";
+                return false;
+        }
+
+        injection->flags |= KI_FLG_REMOVE;
+        return true;
+}
+
+/*
+ * Parse REPLAY keyword. Every REPLAY adds one modification, described
+ * as cpu:hit:TYPE:0xoffset:size:0xmask like in a record.
+ * Returns true on success.
+ */
+static bool ki_parse_replay(char *buffer, size_t len, size_t *pos,
+                            char** msg, struct ki_injection *injection)
+{
+        long cpu, hit, size;
+        unsigned long offset, mask;
+        unsigned int i;
+        struct ki_replay *replay;
+
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_replay))) {
+                *msg = "REPLAY keyword expected";
+                return false;
+        }
+        
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "REPLAY cpu:hit:type:offset:size:mask expected";
+                return false;
+        }
+
+        if (!ki_parse_dec(buffer, pos, &cpu) || cpu < 0 || cpu > INT_MAX ||
+            !ki_parse_skip_colon(buffer, pos) ||
+            !ki_parse_dec(buffer, pos, &hit) || hit <= 0 ||
+            !ki_parse_skip_colon(buffer, pos)) {
+                *msg = "Wrong REPLAY cpu or hit";
+                return false;
+        }
+
+        for (i = 0; i < ARRAY_SIZE(ki_replay_types); ++i)
+                if (ki_parse_keyword(buffer, len, pos, ki_replay_types[i].key,
+                                     ki_replay_types[i].len))
+                        break;
+        if (i == ARRAY_SIZE(ki_replay_types) ||
+            !ki_parse_skip_colon(buffer, pos)) {
+                *msg = "Wrong REPLAY type";
+                return false;
+        }
+
+        if (!ki_parse_hex_prefix(buffer, pos) ||
+            !ki_parse_hex(buffer, pos, &offset) ||
+            !ki_parse_skip_colon(buffer, pos) ||
+            !ki_parse_dec(buffer, pos, &size) ||
+            (size != 1 && size != 2 && size != 4 && size != 8) ||
+            !ki_parse_skip_colon(buffer, pos)) {
+                *msg = "Wrong REPLAY offset or size";
+                return false;
+        }
+
+        if (!ki_parse_hex_prefix(buffer, pos) ||
+            !ki_parse_hex(buffer, pos, &mask) || !mask ||
+            (size < 8 && (mask >> (size * 8)))) {
+                *msg = "Wrong REPLAY mask";
+                return false;
+        }
+
+        /* Entries are grown twice when full */
+        if (injection->replay_count == injection->replay_size) {
+                unsigned int count = injection->replay_size ?
+                                     injection->replay_size * 2 : 16;
+
+                if (count > KI_REPLAY_MAX) {
+                        *msg = "Too many REPLAY entries";
+                        return false;
+                }
+
+                replay = krealloc(injection->replay, count * sizeof(*replay),
+                                  GFP_KERNEL);
+                if (!replay) {
+                        *msg = "Cannot allocate REPLAY entries";
+                        return false;
+                }
+                injection->replay = replay;
+                injection->replay_size = count;
+        }
+
+        replay = &injection->replay[injection->replay_count++];
+        replay->hit = hit;
+        replay->mask = mask;
+        replay->offset = offset;
+        replay->cpu = cpu;
+        replay->type = ki_replay_types[i].type;
+        replay->size = size;
+        return true;
+}
+
 /*
  * Parse RODATA keyword.
  * Returns true on success.
@@ -473,6 +1046,49 @@ static bool ki_parse_stack(const char *buffer, size_t len, size_t *pos,
         return true;
 }
 
+/*
+ * Parse TIMER_JITTER keyword
+ * Returns true on success.
+ */
+static bool ki_parse_timer_jitter(char *buffer, size_t len, size_t *pos,
+                                  char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_timer_jitter))) {
+                *msg = "TIMER_JITTER keyword expected";
+                return false;
+        }
+        
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "TIMER_JITTER number of nanoseconds expected";
+                return false;
+        }
+
+        if (!ki_parse_dec(buffer, pos, &injection->timer_jitter)) {
+                *msg = "Wrong TIMER_JITTER argument";
+                return false;
+        }
+
+        return true;
+}
+
+/*
+ * Parse TIMER_PERCPU keyword.
+ * Returns true on success.
+ */
+static bool ki_parse_timer_percpu(const char *buffer, size_t len, size_t *pos,
+                                  char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_timer_percpu))) {
+                *msg = "TIMER_PERCPU keyword expected";
+                return false;
+        }
+        
+        injection->flags |= KI_FLG_TIMER_PERCPU;
+        return true;
+}
+
 /*
  * Parse TRIGGER keyword
  * Returns true on success.
@@ -530,6 +1146,64 @@ static bool ki_parse_trigger_offset(char *buffer, size_t len, size_t *pos,
         return true;
 }
 
+/*
+ * Parse TRIGGER_TIMER keyword
+ * Returns true on success.
+ */
+static bool ki_parse_trigger_timer(char *buffer, size_t len, size_t *pos,
+                                   char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_trigger_timer))) {
+                *msg = "TRIGGER_TIMER keyword expected";
+                return false;
+        }
+        
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "TRIGGER_TIMER number of nanoseconds expected";
+                return false;
+        }
+
+        if (!ki_parse_dec(buffer, pos, &injection->timer_period)) {
+                *msg = "Wrong TRIGGER_TIMER argument";
+                return false;
+        }
+
+        return true;
+}
+
+/*
+ * Parse TRIGGER_MODE keyword
+ * Returns true on success.
+ */
+static bool ki_parse_trigger_mode(char *buffer, size_t len, size_t *pos,
+                                  char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                             KEYWORD(ki_key_trigger_mode))) {
+                *msg = "TRIGGER_MODE keyword expected";
+                return false;
+        }
+        
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "TRIGGER_MODE AUTO, KPROBE or FTRACE expected";
+                return false;
+        }
+
+        if (ki_parse_keyword(buffer, len, pos, KEYWORD(ki_key_auto)))
+                injection->trigger_mode = KI_TRIG_AUTO;
+        else if (ki_parse_keyword(buffer, len, pos, KEYWORD(ki_key_kprobe)))
+                injection->trigger_mode = KI_TRIG_KPROBE;
+        else if (ki_parse_keyword(buffer, len, pos, KEYWORD(ki_key_ftrace)))
+                injection->trigger_mode = KI_TRIG_FTRACE;
+        else {
+                *msg = "Wrong TRIGGER_MODE argument";
+                return false;
+        }
+
+        return true;
+}
+
 /*
  * Parse SEED keyword
  * Returns true on success.
@@ -556,6 +1230,33 @@ static bool ki_parse_seed(char *buffer, size_t len, size_t *pos,
         return true;
 }
 
+/*
+ * Parse SHOW keyword
+ * Returns true on success.
+ */
+static bool ki_parse_show(char *buffer, size_t len, size_t *pos,
+                          char** msg, struct ki_injection *injection)
+{
+        if (!ki_parse_keyword(buffer, len, pos, 
+                              KEYWORD(ki_key_show))) {
+                *msg = "SHOW keyword expected";
+                return false;
+        }
+        
+        if (!ki_parse_skip_space(buffer, pos)) {
+                *msg = "SHOW injection id expected";
+                return false;
+        }
+
+        if (!ki_parse_dec(buffer, pos, &injection->ref_id)) {
+                *msg = "Wrong SHOW argument";
+                return false;
+        }
+
+        injection->flags |= KI_FLG_SHOW;
+        return true;
+}
+
 /*
  * Check if 'ckpos' character after current position is a 'c' character.
  * Returns true on success.
@@ -578,17 +1279,37 @@ bool ki_parse(char *buffer, size_t len, size_t *pos,
 {
         *pos = 0;
 
-        while (!iscntrl(buffer[*pos])) {
-                /* Eat all white characters */
-                while (isspace(buffer[*pos])) ++*pos;
-                printk(MODULE_PRINTK_DBG "Left: %s", buffer + *pos);
+        for (;;) {
+                /* Eat blanks, any other control character ends command */
+                while (*pos < len && 
+                       (buffer[*pos] == ' ' || buffer[*pos] == '\t'))
+                        ++*pos;
+                if (*pos >= len || iscntrl(buffer[*pos])) break;
 
                 switch (buffer[*pos]) {
+                case 'A':
+                        if (!ki_parse_atomic(buffer, len, pos, msg, injection))
+                                return false;
+                        break;
                 case 'B':
+                        if (ki_parse_check_char(buffer, len, *pos, 1, 'S')) {
+                                if (!ki_parse_bss(buffer, len, pos, msg,
+                                                  injection))
+                                        return false;
+                                else break;
+                        }
+
                         if (!ki_parse_bitflip(buffer, len, pos, msg, injection))
                                 return false;
                         break;
                 case 'C':
+                        if (ki_parse_check_char(buffer, len, *pos, 1, 'A')) {
+                                if (!ki_parse_campaign(buffer, len, pos, msg,
+                                                       injection))
+                                        return false;
+                                else break;
+                        }
+
                         if (ki_parse_check_char(buffer, len, *pos, 1, 'L')) {
                                 if (!ki_parse_clear(buffer, len, pos, msg,
                                                     injection))
@@ -599,6 +1320,13 @@ bool ki_parse(char *buffer, size_t len, size_t *pos,
                                 return false;
                         break;
                 case 'D':
+                        if (ki_parse_check_char(buffer, len, *pos, 1, 'U')) {
+                                if (!ki_parse_duration(buffer, len, pos, msg,
+                                                       injection))
+                                    return false;
+                                else break;
+                        }
+
                         if (ki_parse_check_char(buffer, len, *pos, 1, 'E')) {
                                 if (!ki_parse_debug(buffer, len, pos, msg,
                                                     injection))
@@ -609,7 +1337,29 @@ bool ki_parse(char *buffer, size_t len, size_t *pos,
                         if (!ki_parse_data(buffer, len, pos, msg, injection))
                                 return false;
                         break;
+                case 'E':
+                        if (!ki_parse_every(buffer, len, pos, msg, injection))
+                                return false;
+                        break;
+                case 'F':
+                        if (!ki_parse_fault(buffer, len, pos, msg, injection))
+                                return false;
+                        break;
                 case 'I':
+                        if (ki_parse_check_char(buffer, len, *pos, 2, 'I')) {
+                                if (!ki_parse_init(buffer, len, pos, msg,
+                                                   injection))
+                                        return false;
+                                else break;
+                        }
+
+                        if (ki_parse_check_char(buffer, len, *pos, 2, 'T')) {
+                                if (!ki_parse_interval(buffer, len, pos, msg,
+                                                       injection))
+                                        return false;
+                                else break;
+                        }
+
                         if (ki_parse_check_char(buffer, len, *pos, 7, 'I')) {
                                 if (!ki_parse_inject_into(buffer, len, pos, msg,
                                                           injection))
@@ -632,7 +1382,51 @@ bool ki_parse(char *buffer, size_t len, size_t *pos,
                         if (!ki_parse_module(buffer, len, pos, msg, injection))
                                 return false;
                         break;
+                case 'O':
+                        if (!ki_parse_outcome(buffer, len, pos, msg, injection))
+                                return false;
+                        break;
+                case 'P':
+                        if (ki_parse_check_char(buffer, len, *pos, 1, 'E')) {
+                                if (!ki_parse_percpu(buffer, len, pos, msg,
+                                                     injection))
+                                        return false;
+                                else break;
+                        }
+
+                        if (ki_parse_check_char(buffer, len, *pos, 1, 'O')) {
+                                if (!ki_parse_poisson(buffer, len, pos, msg,
+                                                      injection))
+                                        return false;
+                                else break;
+                        }
+
+                        if (ki_parse_check_char(buffer, len, *pos, 3, 'F')) {
+                                if (!ki_parse_profile(buffer, len, pos, msg,
+                                                      injection))
+                                        return false;
+                                else break;
+                        }
+
+                        if (!ki_parse_probability(buffer, len, pos, msg,
+                                                  injection))
+                                return false;
+                        break;
                 case 'R':
+                        if (ki_parse_check_char(buffer, len, *pos, 2, 'M')) {
+                                if (!ki_parse_remove(buffer, len, pos, msg, 
+                                                     injection))
+                                        return false;
+                                else break;
+                        }
+
+                        if (ki_parse_check_char(buffer, len, *pos, 2, 'P')) {
+                                if (!ki_parse_replay(buffer, len, pos, msg, 
+                                                     injection))
+                                        return false;
+                                else break;
+                        }
+
                         if (ki_parse_check_char(buffer, len, *pos, 1, 'E')) {
                                 if (!ki_parse_regs(buffer, len, pos, msg, 
                                                    injection))
@@ -659,10 +1453,49 @@ bool ki_parse(char *buffer, size_t len, size_t *pos,
                                 else break;
                         }
 
+                        if (ki_parse_check_char(buffer, len, *pos, 1, 'H')) {
+                                if (!ki_parse_show(buffer, len, pos, msg, 
+                                                   injection))
+                                        return false;
+                                else break;
+                        }
+
                         if (!ki_parse_stack(buffer, len, pos, msg, injection))
                                 return false;
                         break;
                 case 'T':
+                        if (ki_parse_check_char(buffer, len, *pos, 1, 'I')) {
+                                if (ki_parse_check_char(buffer, len, *pos, 
+                                                        6, 'P')) {
+                                        if (!ki_parse_timer_percpu(buffer, len,
+                                                                   pos, msg,
+                                                                   injection))
+                                                return false;
+                                        else break;
+                                }
+
+                                if (!ki_parse_timer_jitter(buffer, len, pos,
+                                                           msg, injection))
+                                        return false;
+                                else break;
+                        }
+
+                        if (ki_parse_check_char(buffer, len, *pos, 8, 'T')) {
+                                if (!ki_parse_trigger_timer(buffer, len, 
+                                                            pos, msg, 
+                                                            injection))
+                                        return false;
+                                else break;
+                        }
+
+                        if (ki_parse_check_char(buffer, len, *pos, 8, 'M')) {
+                                if (!ki_parse_trigger_mode(buffer, len, 
+                                                           pos, msg, 
+                                                           injection))
+                                        return false;
+                                else break;
+                        }
+
                         if (ki_parse_check_char(buffer, len, *pos, 7, '_')) {
                                 if (!ki_parse_trigger_offset(buffer, len, 
                                                              pos, msg, 
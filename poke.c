@@ -0,0 +1,329 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#include <linux/kallsyms.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/hardirq.h>
+#include <linux/irq_work.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/smp.h>
+#include <asm/pgtable.h>
+#include <asm/processor.h>
+#include "poke.h"
+
+/* --- GLOBALS ------------------------------------------------------------- */
+/* Text patching of the kernel, not exported to modules */
+static void *(*ki_text_poke)(void *addr, const void *opcode, size_t len);
+static struct mutex *ki_text_mutex;
+static unsigned long ki_stext;
+static unsigned long ki_etext;
+
+/* Text words of trigger handlers written later by a worker. Places are
+ * reserved when words are added, so accepted words are never dropped. */
+static DEFINE_RAW_SPINLOCK(ki_poke_lock);
+static unsigned int ki_poke_deferred;
+static unsigned int ki_poke_reserved;   /* Text words not flushed yet */
+static struct ki_poke_word ki_poke_defer[KI_POKE_DEFER];
+static struct ki_poke_word ki_poke_work_words[KI_POKE_DEFER];
+static void ki_poke_work(struct work_struct *work);
+static DECLARE_WORK(ki_poke_worker, ki_poke_work);
+static bool ki_poke_ready;
+
+/* --- FUNCTIONS ----------------------------------------------------------- */
+/*
+ * Resolve kernel text patching symbols. Without them text is written
+ * through its live mapping like read-only data.
+ */
+void ki_poke_init(void)
+{
+        ki_text_poke = (void*) kallsyms_lookup_name("text_poke");
+        ki_text_mutex = (struct mutex*) kallsyms_lookup_name("text_mutex");
+        ki_stext = kallsyms_lookup_name("_stext");
+        ki_etext = kallsyms_lookup_name("_etext");
+        ki_poke_ready = true;
+}
+
+/*
+ * Write word of 1, 2, 4 or 8 bytes with a single store
+ */
+static inline void ki_word_write(unsigned long addr, unsigned int size,
+                                 u64 value)
+{
+        switch (size) {
+        case 1:  *(u8*)addr = value; break;
+        case 2:  *(u16*)addr = value; break;
+        case 4:  *(u32*)addr = value; break;
+        default: *(u64*)addr = value; break;
+        }
+}
+
+/*
+ * Get new value of a word from its current value
+ */
+static inline u64 ki_poke_value(struct ki_poke_word *word)
+{
+        u64 old = ki_word_read(word->addr, word->size);
+        return ((old & ~word->clear) | word->set) ^ word->flip;
+}
+
+/*
+ * Check if address is kernel or module text. Must be called with
+ * preemption disabled.
+ */
+static bool ki_poke_is_text(unsigned long addr)
+{
+        if (addr >= ki_stext && addr < ki_etext) return true;
+        return __module_text_address(addr) != NULL;
+}
+
+/*
+ * Write words of one page through its live mapping, words of unmapped
+ * page are skipped. Read-only page is written with write protection of
+ * this CPU turned off and interrupts disabled. Page tables are not
+ * changed, so other CPUs never see the page writable and no TLB flush is
+ * needed.
+ */
+static void ki_poke_page(struct ki_poke_word *words, unsigned int count)
+{
+        bool ro;
+        unsigned int i, level;
+        unsigned long flags, cr0 = 0;
+        pte_t *pte = lookup_address(words[0].addr, &level);
+
+        if (!pte || !pte_present(*pte)) return;
+
+        ro = !pte_write(*pte);
+        local_irq_save(flags);
+        if (ro) {
+                cr0 = read_cr0();
+                write_cr0(cr0 & ~X86_CR0_WP);
+        }
+
+        for (i = 0; i < count; ++i)
+                ki_word_write(words[i].addr, words[i].size,
+                              ki_poke_value(&words[i]));
+
+        if (ro) write_cr0(cr0);
+        local_irq_restore(flags);
+}
+
+/*
+ * Serialize instruction stream of the calling CPU
+ */
+static void ki_poke_sync_core(void *data)
+{
+        sync_core();
+}
+
+/*
+ * Write words of one text page through text_poke's temporary mapping,
+ * or through the live mapping when text_poke is not found. Must be
+ * called with text_mutex held, if it's found, and preemption disabled.
+ * Caller serializes all CPUs afterwards.
+ */
+static void ki_poke_text(struct ki_poke_word *words, unsigned int count)
+{
+        unsigned int i;
+
+        if (!ki_text_poke) {
+                ki_poke_page(words, count);
+                return;
+        }
+
+        for (i = 0; i < count; ++i) {
+                u64 value = ki_poke_value(&words[i]);
+                ki_text_poke((void*) words[i].addr, &value, words[i].size);
+        }
+}
+
+/*
+ * Write deferred text words in process context. Words of module text
+ * which is gone in the meantime are skipped.
+ */
+static void ki_poke_work(struct work_struct *work)
+{
+        unsigned int i, count;
+        unsigned long flags;
+        struct ki_poke_word *words = ki_poke_work_words;
+
+        raw_spin_lock_irqsave(&ki_poke_lock, flags);
+        count = ki_poke_deferred;
+        memcpy(words, ki_poke_defer, count * sizeof(*words));
+        ki_poke_deferred = 0;
+        raw_spin_unlock_irqrestore(&ki_poke_lock, flags);
+
+        if (!count) return;
+
+        if (ki_text_mutex) mutex_lock(ki_text_mutex);
+        preempt_disable();
+        for (i = 0; i < count; ++i)
+                if (ki_poke_is_text(words[i].addr))
+                        ki_poke_text(&words[i], 1);
+        preempt_enable();
+        if (ki_text_mutex) mutex_unlock(ki_text_mutex);
+
+        on_each_cpu(ki_poke_sync_core, NULL, 1);
+}
+
+/*
+ * Schedule deferred text writes from interrupt context
+ */
+static void ki_poke_kick(struct irq_work *work)
+{
+        schedule_work(&ki_poke_worker);
+}
+
+static struct irq_work ki_poke_irq_work = {
+        .func = ki_poke_kick
+};
+
+/*
+ * Reserve place of a text word in deferred words, so every accepted word
+ * can be deferred when it's flushed. Works in any context.
+ * Returns false if deferred words are full.
+ */
+static bool ki_poke_reserve(void)
+{
+        unsigned long flags;
+        bool reserved;
+
+        raw_spin_lock_irqsave(&ki_poke_lock, flags);
+        reserved = ki_poke_deferred + ki_poke_reserved < KI_POKE_DEFER;
+        if (reserved) ki_poke_reserved++;
+        raw_spin_unlock_irqrestore(&ki_poke_lock, flags);
+
+        return reserved;
+}
+
+/*
+ * Pass reserved text words to the worker, or release their places if
+ * they were written, when queue is false. Works in any context.
+ */
+static void ki_poke_queue(struct ki_poke_word *words, unsigned int count,
+                          bool queue)
+{
+        unsigned long flags;
+        bool queued = false;
+
+        raw_spin_lock_irqsave(&ki_poke_lock, flags);
+        ki_poke_reserved -= count;
+        if (queue) {
+                memcpy(&ki_poke_defer[ki_poke_deferred], words,
+                       count * sizeof(*words));
+                ki_poke_deferred += count;
+                queued = ki_poke_ready;
+        }
+        raw_spin_unlock_irqrestore(&ki_poke_lock, flags);
+
+        /* Workqueue can't be used from NMI or with runqueue locks held */
+        if (queued) irq_work_queue(&ki_poke_irq_work);
+}
+
+/*
+ * Wait for deferred text words. Called after all injections are gone.
+ */
+void ki_poke_exit(void)
+{
+        ki_poke_ready = false;
+        irq_work_sync(&ki_poke_irq_work);
+        flush_work(&ki_poke_worker);
+}
+
+/*
+ * Add modification of a naturally aligned word. Modifications are
+ * written when batch is full or flushed. Text word is accepted only if
+ * it can be deferred, KI_POKE_DEFER words wait for the worker at most.
+ * Must be called with preemption disabled.
+ * Returns false if word is dropped and won't be written.
+ */
+bool ki_poke_add(struct ki_poke *poke, unsigned long addr, unsigned int size,
+                 u64 clear, u64 set, u64 flip)
+{
+        struct ki_poke_word *word;
+        bool text = ki_poke_is_text(addr);
+
+        if (text && !ki_poke_reserve()) return false;
+
+        if (poke->count == KI_POKE_MAX)
+                ki_poke_flush(poke);
+
+        word = &poke->words[poke->count++];
+        word->text = text;
+        word->addr = addr;
+        word->size = size;
+        word->clear = clear;
+        word->set = set;
+        word->flip = flip;
+        return true;
+}
+
+/*
+ * Write all collected modifications grouped by page. In process context
+ * text is patched with text_poke when text_mutex can be taken without
+ * sleeping and all CPUs are serialized afterwards. Text modifications of
+ * trigger handlers, which may run with scheduler locks held where
+ * text_mutex can't be released or other CPUs interrupted, or when the
+ * mutex is busy, are deferred to a worker doing the same. Must be called
+ * with preemption disabled.
+ */
+void ki_poke_flush(struct ki_poke *poke)
+{
+        unsigned int i, j;
+        bool locked = false, synced = false;
+        struct ki_poke_word *words = poke->words;
+
+        /* Sort words by address, there is only a few of them */
+        for (i = 1; i < poke->count; ++i) {
+                struct ki_poke_word word = words[i];
+                for (j = i; j > 0 && words[j - 1].addr > word.addr; --j)
+                        words[j] = words[j - 1];
+                words[j] = word;
+        }
+
+        for (i = 0; i < poke->count; i = j) {
+                unsigned long page = words[i].addr & PAGE_MASK;
+                bool text = words[i].text;
+
+                for (j = i + 1; j < poke->count; ++j)
+                        if ((words[j].addr & PAGE_MASK) != page ||
+                            words[j].text != text)
+                                break;
+
+                if (!text) {
+                        ki_poke_page(&words[i], j - i);
+                        continue;
+                }
+
+                if (poke->process && !locked && ki_text_mutex)
+                        locked = mutex_trylock(ki_text_mutex);
+
+                if (poke->process && (locked || !ki_text_mutex)) {
+                        ki_poke_text(&words[i], j - i);
+                        ki_poke_queue(&words[i], j - i, false);
+                        synced = true;
+                } else {
+                        ki_poke_queue(&words[i], j - i, true);
+                }
+        }
+
+        if (locked) mutex_unlock(ki_text_mutex);
+        if (synced) on_each_cpu(ki_poke_sync_core, NULL, 1);
+        poke->count = 0;
+}
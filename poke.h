@@ -0,0 +1,84 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_POKE_H
+#define KI_POKE_H
+
+#include <linux/types.h>
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_POKE_MAX 8
+#define KI_POKE_DEFER 64        /* Text words waiting for process context */
+
+/* --- POKE STRUCTURES ----------------------------------------------------- */
+/*
+ * Pending modification of one naturally aligned word
+ */
+struct ki_poke_word
+{
+        unsigned long addr;
+        unsigned int  size;     /* 1, 2, 4 or 8 bytes */
+        u64           clear;    /* Bits cleared */
+        u64           set;      /* Bits set after clearing */
+        u64           flip;     /* Bits inverted at last */
+        bool          text;     /* Place in deferred words is reserved */
+};
+
+/*
+ * Modifications of one injection. They are written together, grouped by
+ * page, when the injection is done.
+ */
+struct ki_poke
+{
+        unsigned int        count;
+        bool                process;    /* Started in process context */
+        struct ki_poke_word words[KI_POKE_MAX];
+};
+
+/* --- POKE FUNCTIONS ------------------------------------------------------ */
+/*
+ * Read word of 1, 2, 4 or 8 bytes
+ */
+static inline u64 ki_word_read(unsigned long addr, unsigned int size)
+{
+        switch (size) {
+        case 1:  return *(u8*)addr;
+        case 2:  return *(u16*)addr;
+        case 4:  return *(u32*)addr;
+        default: return *(u64*)addr;
+        }
+}
+
+/*
+ * Start collecting modifications of an injection. Process is true only
+ * for campaign threads and commands, trigger handlers may run in any
+ * context and their text modifications are deferred.
+ */
+static inline void ki_poke_start(struct ki_poke *poke, bool process)
+{
+        poke->count = 0;
+        poke->process = process;
+}
+
+void ki_poke_init(void);
+void ki_poke_exit(void);
+bool ki_poke_add(struct ki_poke *poke, unsigned long addr, unsigned int size,
+                 u64 clear, u64 set, u64 flip);
+void ki_poke_flush(struct ki_poke *poke);
+
+#endif /*KI_POKE_H*/
@@ -0,0 +1,379 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#include <linux/hashtable.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/cpumask.h>
+#include "probe.h"
+#include "execute.h"
+#include "trace.h"
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_PROBE_BITS 6
+#define KI_PROBE_CALLS 64       /* Minimal number of tracked injected calls */
+
+/* --- GLOBALS ------------------------------------------------------------- */
+/* Probes by address, protected by registry writers lock */
+static DEFINE_HASHTABLE(ki_probes, KI_PROBE_BITS);
+
+/* --- HANDLERS ------------------------------------------------------------ */
+/*
+ * Dispatch probe hit to all attached injections in one pass. Must be
+ * called with preemption disabled.
+ * Returns true if any injection was executed.
+ */
+static bool ki_probe_dispatch(struct ki_probe *probe, struct pt_regs *regs)
+{
+        struct ki_probe_table *table = rcu_dereference_sched(probe->table);
+
+        return ki_execute_hit(table->injections, table->count, regs);
+}
+
+/*
+ * Kprobe handler of a shared probe
+ */
+static int ki_probe_kp_handler(struct kprobe *p, struct pt_regs *regs)
+{
+        ki_probe_dispatch(container_of(p, struct ki_probe, kp), regs);
+        return 0;
+}
+
+/*
+ * Ftrace handler of a shared probe on function entry. It's called from
+ * function's fentry call, without breakpoint exception.
+ */
+static void notrace ki_probe_ftrace_handler(unsigned long ip,
+                                            unsigned long parent_ip,
+                                            struct ftrace_ops *ops,
+                                            struct pt_regs *regs)
+{
+        preempt_disable_notrace();
+        ki_probe_dispatch(container_of(ops, struct ki_probe, ops), regs);
+        preempt_enable_notrace();
+}
+
+/*
+ * Kretprobe entry handler. Return is tracked only for injected calls.
+ */
+static int ki_probe_entry_handler(struct kretprobe_instance *ri,
+                                  struct pt_regs *regs)
+{
+        struct ki_probe *probe = container_of(ri->rp, struct ki_probe, rp);
+        struct ki_probe_call *call = (struct ki_probe_call*) ri->data;
+
+        if (!ki_probe_dispatch(probe, regs)) return 1;
+        call->start = local_clock();
+        return 0;
+}
+
+/*
+ * Kretprobe return handler, reports outcome of an injected call
+ */
+static int ki_probe_ret_handler(struct kretprobe_instance *ri,
+                                struct pt_regs *regs)
+{
+        struct ki_probe *probe = container_of(ri->rp, struct ki_probe, rp);
+        struct ki_probe_call *call = (struct ki_probe_call*) ri->data;
+        struct ki_probe_table *table = rcu_dereference_sched(probe->table);
+        struct ki_injection *injection = ACCESS_ONCE(table->injections[0]);
+
+        if (injection)
+                ki_execute_return(injection, regs_return_value(regs),
+                                  local_clock() - call->start);
+        return 0;
+}
+
+/* --- PROBE TABLE --------------------------------------------------------- */
+/*
+ * Free replaced probe table after handlers are done with it
+ */
+static void ki_probe_table_free(struct rcu_head *head)
+{
+        kfree(container_of(head, struct ki_probe_table, rcu));
+}
+
+/*
+ * Copy probe table without removed injection and with added one. Both
+ * may be NULL, holes of the old table are dropped.
+ * Returns NULL if memory can't be allocated.
+ */
+static struct ki_probe_table *ki_probe_table_copy(struct ki_probe_table *old,
+                                                  struct ki_injection *add,
+                                                  struct ki_injection *remove)
+{
+        unsigned int i;
+        unsigned int count = old ? old->count : 0;
+        struct ki_probe_table *table;
+
+        table = kmalloc(sizeof(*table) + 
+                        (count + 1) * sizeof(table->injections[0]),
+                        GFP_KERNEL);
+        if (!table) return NULL;
+
+        table->count = 0;
+        for (i = 0; i < count; ++i) {
+                struct ki_injection *injection = old->injections[i];
+                if (injection && injection != remove)
+                        table->injections[table->count++] = injection;
+        }
+        if (add) table->injections[table->count++] = add;
+
+        return table;
+}
+
+/*
+ * Free unregistered probe after registry readers are done with it
+ */
+static void ki_probe_free_rcu(struct rcu_head *head)
+{
+        struct ki_probe *probe = container_of(head, struct ki_probe, rcu);
+
+        kfree(rcu_dereference_protected(probe->table, 1));
+        kfree(probe);
+}
+
+/*
+ * Wait for registry readers after probe handlers are done with probe
+ */
+static void ki_probe_free_sched(struct rcu_head *head)
+{
+        call_rcu(head, ki_probe_free_rcu);
+}
+
+/* --- PROBE REGISTRATION -------------------------------------------------- */
+/*
+ * Register probe of its selected type.
+ * Returns true on success.
+ */
+static bool ki_probe_register(struct ki_probe *probe)
+{
+        bool ok;
+
+        if (probe->mode == KI_TRIG_KRETPROBE) {
+                probe->rp.kp.addr = (kprobe_opcode_t*) probe->addr;
+                probe->rp.entry_handler = ki_probe_entry_handler;
+                probe->rp.handler = ki_probe_ret_handler;
+                probe->rp.data_size = sizeof(struct ki_probe_call);
+                probe->rp.maxactive = max_t(int, KI_PROBE_CALLS,
+                                            4 * num_possible_cpus());
+                ok = register_kretprobe(&probe->rp) == 0;
+        } else if (probe->mode == KI_TRIG_KPROBE) {
+                probe->kp.addr = (kprobe_opcode_t*) probe->addr;
+                probe->kp.pre_handler = ki_probe_kp_handler;
+                ok = register_kprobe(&probe->kp) == 0;
+        } else {
+                probe->ops.func = ki_probe_ftrace_handler;
+                probe->ops.flags = FTRACE_OPS_FL_SAVE_REGS;
+
+                /* Fails if address is not a traceable function entry */
+                ok = !ftrace_set_filter_ip(&probe->ops, probe->addr, 0, 0);
+                if (ok && register_ftrace_function(&probe->ops)) {
+                        ftrace_set_filter_ip(&probe->ops, probe->addr, 1, 0);
+                        ok = false;
+                }
+        }
+
+        return ok;
+}
+
+/*
+ * Unregister probe. Handlers are finished when this function returns.
+ */
+static void ki_probe_unregister(struct ki_probe *probe)
+{
+        if (probe->mode == KI_TRIG_KRETPROBE) {
+                unregister_kretprobe(&probe->rp);
+                return;
+        }
+
+        if (probe->mode == KI_TRIG_KPROBE) {
+                unregister_kprobe(&probe->kp);
+                return;
+        }
+
+        unregister_ftrace_function(&probe->ops);
+        ftrace_set_filter_ip(&probe->ops, probe->addr, 1, 0);
+}
+
+/*
+ * Create and register new probe for an injection. Function entries are
+ * traced with ftrace by default, kprobes are used for other addresses and
+ * when ftrace can't be used. OUTCOME injections get a private kretprobe,
+ * which is never shared.
+ * Returns true on success.
+ */
+static bool ki_probe_create(struct ki_injection *injection,
+                            unsigned long addr, char **msg)
+{
+        struct ki_probe *probe;
+        struct ki_probe_table *table;
+
+        probe = kzalloc(sizeof(*probe), GFP_KERNEL);
+        table = ki_probe_table_copy(NULL, injection, NULL);
+        if (!probe || !table) {
+                *msg = "Cannot allocate probe";
+                goto fail;
+        }
+
+        probe->addr = addr;
+        RCU_INIT_POINTER(probe->table, table);
+
+        if (injection->flags & KI_FLG_OUTCOME) {
+                probe->mode = KI_TRIG_KRETPROBE;
+                if (!ki_probe_register(probe)) {
+                        *msg = "Cannot register kretprobe";
+                        goto fail;
+                }
+                trace_ki_probe_arm(injection->id, addr, probe->mode, false,
+                                   true);
+                injection->probe = probe;
+                return true;
+        }
+
+        switch (injection->trigger_mode) {
+        case KI_TRIG_FTRACE:
+                probe->mode = KI_TRIG_FTRACE;
+                if (ki_probe_register(probe)) goto out;
+                *msg = "Cannot register ftrace trigger";
+                goto fail;
+        case KI_TRIG_AUTO:
+                probe->mode = KI_TRIG_FTRACE;
+                if (!injection->trigger_offset && ki_probe_register(probe))
+                        goto out;
+                /* Fall through */
+        case KI_TRIG_KPROBE:
+        default:
+                probe->mode = KI_TRIG_KPROBE;
+                if (ki_probe_register(probe)) goto out;
+                *msg = "Cannot register kprobe";
+                goto fail;
+        }
+
+fail:
+        trace_ki_probe_arm(injection->id, addr, probe ? probe->mode : 0,
+                           false, false);
+        kfree(table);
+        kfree(probe);
+        return false;
+
+out:
+        trace_ki_probe_arm(injection->id, addr, probe->mode, false, true);
+        hash_add(ki_probes, &probe->node, addr);
+        injection->probe = probe;
+        return true;
+}
+
+/* --- FUNCTIONS ----------------------------------------------------------- */
+/*
+ * Attach triggered injection to the probe at its trigger address. Probe is
+ * shared with other injections of the same trigger type, new probe is
+ * registered only if there is none. Must be called with registry writers
+ * lock held.
+ * Returns true on success.
+ */
+bool ki_probe_attach(struct ki_injection *injection, char **msg)
+{
+        struct ki_probe *probe;
+        struct ki_probe_table *old, *table;
+        unsigned long addr = injection->trigger.addr + 
+                             injection->trigger_offset;
+
+        if (injection->flags & KI_FLG_OUTCOME)
+                return ki_probe_create(injection, addr, msg);
+
+        hash_for_each_possible(ki_probes, probe, node, addr) {
+                if (probe->addr != addr)
+                        continue;
+                if (injection->trigger_mode != KI_TRIG_AUTO &&
+                    injection->trigger_mode != probe->mode)
+                        continue;
+
+                old = rcu_dereference_protected(probe->table, 1);
+                table = ki_probe_table_copy(old, injection, NULL);
+                if (!table) {
+                        *msg = "Cannot allocate probe";
+                        trace_ki_probe_arm(injection->id, addr, probe->mode,
+                                           true, false);
+                        return false;
+                }
+
+                rcu_assign_pointer(probe->table, table);
+                call_rcu_sched(&old->rcu, ki_probe_table_free);
+                trace_ki_probe_arm(injection->id, addr, probe->mode, true,
+                                   true);
+                injection->probe = probe;
+                return true;
+        }
+
+        return ki_probe_create(injection, addr, msg);
+}
+
+/*
+ * Detach injection from its probe, probe is unregistered with the last
+ * injection. Handlers may still use the injection until RCU-sched grace
+ * period ends. Must be called with registry writers lock held.
+ */
+void ki_probe_detach(struct ki_injection *injection)
+{
+        unsigned int i, live = 0;
+        struct ki_probe *probe = injection->probe;
+        struct ki_probe_table *old, *table;
+
+        old = rcu_dereference_protected(probe->table, 1);
+        for (i = 0; i < old->count; ++i)
+                if (old->injections[i] && old->injections[i] != injection)
+                        live++;
+        injection->probe = NULL;
+        trace_ki_probe_disarm(injection->id, probe->addr, probe->mode, !live);
+
+        if (!live) {
+                ki_probe_unregister(probe);
+                hash_del(&probe->node);     /* Private probes are not hashed */
+
+                /* Listing may still read kretprobe counters */
+                call_rcu_sched(&probe->rcu, ki_probe_free_sched);
+                return;
+        }
+
+        table = ki_probe_table_copy(old, NULL, injection);
+        if (table) {
+                rcu_assign_pointer(probe->table, table);
+                call_rcu_sched(&old->rcu, ki_probe_table_free);
+                return;
+        }
+
+        /* Out of memory, leave a hole which handlers skip */
+        for (i = 0; i < old->count; ++i)
+                if (old->injections[i] == injection)
+                        ACCESS_ONCE(old->injections[i]) = NULL;
+}
+
+/*
+ * Get number of trigger hits of an OUTCOME injection missed because all
+ * kretprobe instances were in use by calls in flight. Entry handler is
+ * not run for them, so they are neither counted nor injected. Must be
+ * called under RCU read lock.
+ */
+long ki_probe_missed(struct ki_injection *injection)
+{
+        struct ki_probe *probe = ACCESS_ONCE(injection->probe);
+
+        if (!probe || probe->mode != KI_TRIG_KRETPROBE) return 0;
+        return ACCESS_ONCE(probe->rp.nmissed);
+}
@@ -0,0 +1,69 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_PROBE_H
+#define KI_PROBE_H
+
+#include <linux/kprobes.h>
+#include <linux/ftrace.h>
+#include <linux/list.h>
+#include <linux/rcupdate.h>
+#include "injection.h"
+
+/* --- PROBE STRUCTURES ---------------------------------------------------- */
+/*
+ * Injections attached to a probe. Table is replaced as a whole when an
+ * injection is attached or detached, handlers read it under RCU-sched.
+ */
+struct ki_probe_table
+{
+        struct rcu_head      rcu;
+        unsigned int         count;
+        struct ki_injection *injections[];
+};
+
+/*
+ * Entry of an injected call, kept by kretprobe until the call returns
+ */
+struct ki_probe_call
+{
+        u64 start;              /* local_clock() at entry */
+};
+
+/*
+ * Probe shared by all injections triggered at the same address with the
+ * same mechanism
+ */
+struct ki_probe
+{
+        struct rcu_head        rcu;
+        struct hlist_node      node;
+        unsigned long          addr;   /* Trigger address with offset */
+        enum ki_trigger_mode_e mode;   /* KPROBE, FTRACE or KRETPROBE */
+        struct kprobe          kp;
+        struct ftrace_ops      ops;
+        struct kretprobe       rp;     /* Not shared, one injection only */
+        struct ki_probe_table __rcu *table;
+};
+
+/* --- PROBE FUNCTIONS ----------------------------------------------------- */
+bool ki_probe_attach(struct ki_injection *injection, char **msg);
+void ki_probe_detach(struct ki_injection *injection);
+long ki_probe_missed(struct ki_injection *injection);
+
+#endif /*KI_PROBE_H*/
@@ -0,0 +1,225 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#include <linux/kthread.h>
+#include <linux/hrtimer.h>
+#include <linux/vmalloc.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/jiffies.h>
+#include <asm/irq_regs.h>
+#include <asm/ptrace.h>
+#include "profile.h"
+#include "injection.h"
+#include "segment.h"
+#include "kinjector.h"
+
+/* --- SAMPLING ------------------------------------------------------------ */
+/*
+ * Sampling timer handler, counts instruction pointer of the interrupted
+ * kernel code if it's in profiled text
+ */
+static enum hrtimer_restart ki_profile_timer(struct hrtimer *timer)
+{
+        struct ki_pcpu *pcpu = container_of(timer, struct ki_pcpu, timer);
+        struct ki_profile *profile = pcpu->injection->samples;
+        struct pt_regs *regs = get_irq_regs();
+
+        if (regs && !user_mode(regs)) {
+                unsigned long offset = instruction_pointer(regs) - 
+                                       profile->start;
+                if (offset < profile->size) {
+                        atomic_inc(&profile->hist[offset >> profile->shift]);
+                        pcpu->calls++;
+                }
+        }
+
+        hrtimer_forward_now(timer, ns_to_ktime(KI_PROFILE_PERIOD));
+        return HRTIMER_RESTART;
+}
+
+/*
+ * Start sampling timer of current CPU
+ */
+static void ki_profile_timer_start(void *data)
+{
+        struct ki_injection *injection = data;
+
+        hrtimer_start(&this_cpu_ptr(injection->pcpu)->timer,
+                      ns_to_ktime(KI_PROFILE_PERIOD), HRTIMER_MODE_REL_PINNED);
+}
+
+/*
+ * Turn bucket counts into cumulative counts
+ */
+static void ki_profile_accumulate(struct ki_profile *profile)
+{
+        unsigned int i;
+        int total = 0;
+
+        for (i = 0; i < profile->buckets; ++i) {
+                total += atomic_read(&profile->hist[i]);
+                atomic_set(&profile->hist[i], total);
+        }
+}
+
+/*
+ * Profiling thread. Samples are taken on all online CPUs for the given
+ * time, then the profile is published in module's segment table. Thread
+ * is stopped when profile injection is removed.
+ */
+static int ki_profile_thread(void *data)
+{
+        int cpu;
+        struct ki_injection *injection = data;
+        unsigned long deadline = jiffies + msecs_to_jiffies(injection->profile);
+
+        on_each_cpu(ki_profile_timer_start, injection, 1);
+        while (!kthread_should_stop() && time_before(jiffies, deadline))
+                schedule_timeout_interruptible(deadline - jiffies);
+
+        for_each_possible_cpu(cpu)
+                hrtimer_cancel(&per_cpu_ptr(injection->pcpu, cpu)->timer);
+
+        /* Profile is owned by segment table once it's published */
+        if (!kthread_should_stop()) {
+                ki_profile_accumulate(injection->samples);
+                if (ki_segments_set_profile(injection->segments,
+                                            injection->samples))
+                        injection->samples = NULL;
+        }
+
+        /* Profiling is over, wait for removal */
+        ACCESS_ONCE(injection->finished) = 1;
+        set_current_state(TASK_INTERRUPTIBLE);
+        while (!kthread_should_stop()) {
+                schedule();
+                set_current_state(TASK_INTERRUPTIBLE);
+        }
+        __set_current_state(TASK_RUNNING);
+
+        return 0;
+}
+
+/* --- FUNCTIONS ----------------------------------------------------------- */
+/*
+ * Allocate profile of a text segment
+ * Returns NULL if memory can't be allocated.
+ */
+static struct ki_profile *ki_profile_alloc(unsigned long start,
+                                           unsigned long size)
+{
+        unsigned int shift = KI_PROFILE_SHIFT;
+        struct ki_profile *profile;
+
+        while ((size >> shift) >= KI_PROFILE_BUCKETS) ++shift;
+
+        profile = vzalloc(sizeof(*profile) + 
+                          ((size >> shift) + 1) * sizeof(profile->hist[0]));
+        if (!profile) return NULL;
+
+        profile->start = start;
+        profile->size = size;
+        profile->shift = shift;
+        profile->buckets = (size >> shift) + 1;
+        return profile;
+}
+
+/*
+ * Free profile
+ */
+void ki_profile_free(struct ki_profile *profile)
+{
+        vfree(profile);
+}
+
+/*
+ * Start profiling module's text in a thread. Sampling timers share
+ * injection's per CPU state. Injection must have an id.
+ * Returns true on success.
+ */
+bool ki_profile_start(struct ki_injection *injection, char **msg)
+{
+        int cpu;
+        struct ki_seg_map *map;
+        struct ki_segment text = { 0, 0 };
+        struct task_struct *task;
+
+        rcu_read_lock_sched();
+        map = rcu_dereference_sched(injection->segments->map);
+        if (map) text = map->seg[KI_SEG_TEXT];
+        rcu_read_unlock_sched();
+
+        if (!text.size) {
+                *msg = "Module is not loaded";
+                return false;
+        }
+
+        injection->samples = ki_profile_alloc(text.start, text.size);
+        if (!injection->samples) {
+                *msg = "Cannot allocate profile";
+                return false;
+        }
+
+        for_each_possible_cpu(cpu) {
+                struct ki_pcpu *pcpu = per_cpu_ptr(injection->pcpu, cpu);
+                hrtimer_init(&pcpu->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+                pcpu->timer.function = ki_profile_timer;
+                pcpu->injection = injection;
+        }
+        injection->timer_ready = 1;
+
+        task = kthread_run(ki_profile_thread, injection,
+                           MODULE_NAME_STR "/%d", injection->id);
+        if (IS_ERR(task)) {
+                *msg = "Cannot start profile thread";
+                return false;
+        }
+        injection->task = task;
+
+        return true;
+}
+
+/*
+ * Pick a bucket of profiled text with probability proportional to its
+ * samples. Profile must be published.
+ * Returns bucket address and size, 0 if there are no samples.
+ */
+unsigned long ki_profile_pick(struct ki_profile *profile, u64 random,
+                              unsigned long *size)
+{
+        unsigned int lo = 0, hi = profile->buckets - 1;
+        unsigned long offset;
+        u32 total = atomic_read(&profile->hist[hi]);
+
+        if (!total) return 0;
+        random %= total;
+
+        /* Find first bucket with cumulative count above random */
+        while (lo < hi) {
+                unsigned int mid = lo + (hi - lo) / 2;
+                if ((u32) atomic_read(&profile->hist[mid]) > random)
+                        hi = mid;
+                else
+                        lo = mid + 1;
+        }
+
+        offset = (unsigned long) lo << profile->shift;
+        *size = min(1UL << profile->shift, profile->size - offset);
+        return profile->start + offset;
+}
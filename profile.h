@@ -0,0 +1,53 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_PROFILE_H
+#define KI_PROFILE_H
+
+#include <linux/types.h>
+#include <linux/atomic.h>
+
+struct ki_injection;
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_PROFILE_PERIOD  99991        /* Sampling period in ns */
+#define KI_PROFILE_BUCKETS 65536        /* Maximal histogram size */
+#define KI_PROFILE_SHIFT   4            /* Minimal bucket size log2 */
+
+/* --- PROFILE STRUCTURES -------------------------------------------------- */
+/*
+ * Histogram of sampled instruction pointers in module's text. Buckets
+ * count samples while profiling runs and are turned into cumulative
+ * counts before the profile is published.
+ */
+struct ki_profile
+{
+        unsigned long start;            /* Profiled text */
+        unsigned long size;
+        unsigned int  shift;            /* Bucket size log2 */
+        unsigned int  buckets;
+        atomic_t      hist[];
+};
+
+/* --- PROFILE FUNCTIONS --------------------------------------------------- */
+bool ki_profile_start(struct ki_injection *injection, char **msg);
+void ki_profile_free(struct ki_profile *profile);
+unsigned long ki_profile_pick(struct ki_profile *profile, u64 random,
+                              unsigned long *size);
+
+#endif /*KI_PROFILE_H*/
@@ -0,0 +1,162 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/proc_fs.h>
+#include <linux/uaccess.h>
+#include <linux/percpu.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/bitops.h>
+#include "records.h"
+#include "ring.h"
+#include "injection.h"
+#include "kinjector.h"
+#include "netlink.h"
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_RING_SIZE 2048 /* Records per CPU, must be a power of two */
+
+/* --- GLOBALS ------------------------------------------------------------- */
+bool ki_syslog = false;
+module_param_named(syslog, ki_syslog, bool, 0644);
+MODULE_PARM_DESC(syslog, "Describe every injection in syslog");
+
+static DEFINE_PER_CPU(struct ki_ring, ki_rings);
+static DEFINE_MUTEX(ki_records_mutex);
+
+/* --- FUNCTIONS ----------------------------------------------------------- */
+/*
+ * Store injection record in current CPU's ring. Safe in any context,
+ * record is dropped and counted as lost when ring is full or in NMI.
+ */
+void ki_record(struct ki_injection *injection, enum ki_record_type_e type,
+               unsigned long addr, unsigned int size, u64 mask,
+               unsigned int reg, u64 hit, unsigned long offset)
+{
+        unsigned long flags;
+        struct ki_record rec;
+
+        rec.trigger = injection->trigger.addr ? 
+                      injection->trigger.addr + injection->trigger_offset : 0;
+        rec.addr = addr;
+        rec.mask = mask;
+        rec.id = injection->id;
+        rec.type = type;
+        rec.bit = mask ? __ffs64(mask) : 0;
+        rec.reg = reg;
+        rec.size = size;
+        rec.fault = injection->fault;
+        memset(rec.pad, 0, sizeof(rec.pad));
+        rec.hit = hit;
+        rec.offset = offset;
+
+        local_irq_save(flags);
+        rec.timestamp = local_clock();
+        rec.cpu = smp_processor_id();
+
+        /* Netlink listeners get records even if the ring is full */
+        ki_netlink_record(&rec);
+        ki_ring_push(this_cpu_ptr(&ki_rings), &rec);
+        local_irq_restore(flags);
+}
+
+/*
+ * Read as many whole records as fit in a buffer. Records of every CPU
+ * are ordered, records of different CPUs can be compared by timestamp.
+ */
+static ssize_t ki_records_read(struct file *filp, char __user *buffer,
+                               size_t len, loff_t *f_pos)
+{
+        int cpu;
+        ssize_t done = 0;
+        struct ki_record rec;
+
+        if (len < sizeof(rec)) return -EINVAL;
+        if (mutex_lock_interruptible(&ki_records_mutex)) return -EINTR;
+
+        for_each_possible_cpu(cpu) {
+                struct ki_ring *ring = per_cpu_ptr(&ki_rings, cpu);
+
+                while (len - done >= sizeof(rec) &&
+                       ki_ring_pop(ring, cpu, &rec)) {
+                        if (copy_to_user(buffer + done, &rec, sizeof(rec))) {
+                                if (!done) done = -EFAULT;
+                                goto out;
+                        }
+                        ki_ring_release(ring, &rec);
+                        done += sizeof(rec);
+                }
+        }
+
+out:
+        mutex_unlock(&ki_records_mutex);
+        return done;
+}
+
+/*
+ * Records file is a stream of struct ki_record
+ */
+static struct file_operations ki_records_file_ops = {
+        .owner   = THIS_MODULE,
+        .open    = nonseekable_open,
+        .read    = ki_records_read,
+        .llseek  = no_llseek
+};
+
+/*
+ * Allocate rings and create records file
+ */
+int ki_records_init(void)
+{
+        int cpu;
+
+        for_each_possible_cpu(cpu) {
+                struct ki_ring *ring = per_cpu_ptr(&ki_rings, cpu);
+                ring->size = KI_RING_SIZE;
+                ring->buf = vzalloc_node(KI_RING_SIZE * sizeof(*ring->buf),
+                                         cpu_to_node(cpu));
+                if (!ring->buf) goto fail;
+        }
+
+        /* Reading takes records away, so only root may read them */
+        if (!proc_create(MODULE_RECORDS_STR, 0400, NULL, 
+                         &ki_records_file_ops))
+                goto fail;
+
+        return 0;
+
+fail:
+        for_each_possible_cpu(cpu)
+                vfree(per_cpu_ptr(&ki_rings, cpu)->buf);
+        return -ENOMEM;
+}
+
+/*
+ * Remove records file and free rings
+ */
+void ki_records_exit(void)
+{
+        int cpu;
+
+        remove_proc_entry(MODULE_RECORDS_STR, NULL);
+        for_each_possible_cpu(cpu)
+                vfree(per_cpu_ptr(&ki_rings, cpu)->buf);
+}
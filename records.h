@@ -0,0 +1,85 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_RECORDS_H
+#define KI_RECORDS_H
+
+#include <linux/types.h>
+
+/* --- RECORD STRUCTURES --------------------------------------------------- */
+/*
+ * Record types. Every type except KI_REC_LOST describes one modified byte
+ * or word.
+ */
+enum ki_record_type_e
+{
+        KI_REC_TARGET = 1,
+        KI_REC_STACK  = 2,
+        KI_REC_REGS   = 3,
+        KI_REC_DATA   = 4,
+        KI_REC_RODATA = 5,
+        KI_REC_CODE   = 6,
+        KI_REC_LOST   = 7,
+        KI_REC_BSS    = 8,
+        KI_REC_INIT   = 9,
+        KI_REC_PERCPU = 10,
+        KI_REC_RETURN = 11
+};
+
+/*
+ * Binary injection record as read from the records file. KI_REC_LOST
+ * records carry number of dropped records in addr field. KI_REC_RETURN
+ * records carry return value of the trigger function in addr field and
+ * latency from its entry in nanoseconds in mask field. Hit and offset
+ * fields are what REPLAY needs to repeat the modification.
+ */
+struct ki_record
+{
+        __u64 timestamp;        /* local_clock() in nanoseconds */
+        __u64 trigger;          /* Trigger address, 0 if immediate */
+        __u64 addr;             /* Address of modified byte or word */
+        __u64 mask;             /* Changed bits of the word */
+        __u32 id;               /* Injection id */
+        __u16 cpu;
+        __u8  type;             /* enum ki_record_type_e */
+        __u8  bit;              /* Lowest changed bit number */
+        __u16 reg;              /* Byte offset in pt_regs for KI_REC_REGS */
+        __u8  size;             /* Size of modified word in bytes */
+        __u8  fault;            /* enum ki_fault_e */
+        __u16 pad[2];
+        __u64 hit;              /* Hit ordinal of the CPU, campaign
+                                   injection number, 0 if immediate */
+        __u64 offset;           /* Offset of addr from start of the type */
+};
+
+#ifdef __KERNEL__
+
+struct ki_injection;
+
+/* --- RECORD FUNCTIONS ---------------------------------------------------- */
+extern bool ki_syslog;
+
+int ki_records_init(void);
+void ki_records_exit(void);
+void ki_record(struct ki_injection *injection, enum ki_record_type_e type,
+               unsigned long addr, unsigned int size, u64 mask,
+               unsigned int reg, u64 hit, unsigned long offset);
+
+#endif /*__KERNEL__*/
+
+#endif /*KI_RECORDS_H*/
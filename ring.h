@@ -0,0 +1,121 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_RING_H
+#define KI_RING_H
+
+#include <linux/types.h>
+#include <linux/compiler.h>
+#include <linux/hardirq.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <asm/local.h>
+#include "records.h"
+
+/* --- RING STRUCTURES ----------------------------------------------------- */
+/*
+ * Per CPU ring of records with one writer and one reader. Only owning CPU
+ * writes head with interrupts disabled and counts lost records, also from
+ * NMI. Only the reader writes tail and lost_read, readers of one ring
+ * must be serialized by its user.
+ */
+struct ki_ring
+{
+        struct ki_record *buf;
+        unsigned long     size;         /* Power of two */
+        unsigned long     head;
+        unsigned long     tail;
+        local_t           lost;
+        unsigned long     lost_read;
+};
+
+/* --- RING FUNCTIONS ------------------------------------------------------ */
+/*
+ * Store record in current CPU's ring. Must be called with interrupts
+ * disabled. Record is dropped and counted as lost when ring is full or
+ * in NMI, which can interrupt a writer between filling a slot and moving
+ * head.
+ * Returns true if record was stored.
+ */
+static inline bool ki_ring_push(struct ki_ring *ring,
+                                const struct ki_record *rec)
+{
+        unsigned long head = ring->head;
+
+        if (in_nmi() || !ring->buf ||
+            head - ACCESS_ONCE(ring->tail) >= ring->size) {
+                local_inc(&ring->lost);
+                return false;
+        }
+
+        ring->buf[head & (ring->size - 1)] = *rec;
+
+        /* Publish record after it's filled */
+        smp_wmb();
+        ACCESS_ONCE(ring->head) = head + 1;
+        return true;
+}
+
+/*
+ * Take one record from a ring of a CPU. Dropped records are reported
+ * first, as a record of LOST type with their count in an address field.
+ * Ring is not changed until the record is released, so record which
+ * can't be delivered is taken again.
+ * Returns true if record was taken.
+ */
+static inline bool ki_ring_pop(struct ki_ring *ring, int cpu,
+                               struct ki_record *rec)
+{
+        unsigned long head, lost;
+
+        lost = local_read(&ring->lost);
+        if (lost != ring->lost_read) {
+                memset(rec, 0, sizeof(*rec));
+                rec->timestamp = local_clock();
+                rec->addr = lost - ring->lost_read;
+                rec->cpu = cpu;
+                rec->type = KI_REC_LOST;
+                return true;
+        }
+
+        head = ACCESS_ONCE(ring->head);
+        if (head == ring->tail) return false;
+
+        /* Read record only after head is seen */
+        smp_rmb();
+        *rec = ring->buf[ring->tail & (ring->size - 1)];
+        return true;
+}
+
+/*
+ * Release record taken by ki_ring_pop after it was delivered
+ */
+static inline void ki_ring_release(struct ki_ring *ring,
+                                   const struct ki_record *rec)
+{
+        if (rec->type == KI_REC_LOST) {
+                ring->lost_read += rec->addr;
+                return;
+        }
+
+        /* Finish reading before slot can be overwritten */
+        smp_mb();
+        ACCESS_ONCE(ring->tail) = ring->tail + 1;
+}
+
+#endif /*KI_RING_H*/
@@ -0,0 +1,97 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#include <linux/random.h>
+#include <linux/percpu.h>
+#include <linux/bitops.h>
+#include "schedule.h"
+
+/* --- RANDOM -------------------------------------------------------------- */
+/*
+ * Binary logarithm of x > 0 in fixed point with 16 fractional bits
+ */
+static u64 ki_log2_fp16(u64 x)
+{
+        int i;
+        int msb = fls64(x) - 1;
+        u64 result = (u64)msb << 16;
+
+        /* Normalize to [1, 2) with 31 fractional bits */
+        x = msb >= 31 ? x >> (msb - 31) : x << (31 - msb);
+
+        /* Every squaring gives one more bit of the fraction */
+        for (i = 15; i >= 0; --i) {
+                x = (x * x) >> 31;
+                if (x >= (1ULL << 32)) {
+                        x >>= 1;
+                        result |= 1ULL << i;
+                }
+        }
+
+        return result;
+}
+
+/*
+ * Draw number of hits to next injection from exponential distribution
+ * with given mean, so injections form a Poisson process in hit counts.
+ */
+long ki_rand_exp(struct ki_pcpu *pcpu, u64 mean)
+{
+        u64 neglog2, value;
+
+        /* -log2(U) for U uniform in (0, 1], ln(2) = 45426 / 2^16 */
+        neglog2 = (64ULL << 16) - ki_log2_fp16(ki_rand(pcpu) | 1);
+        value = mean * ((neglog2 * 45426) >> 16);
+        value = (value + 0xffff) >> 16;
+
+        return value ? value : 1;
+}
+
+/*
+ * Seed per CPU generators and schedules. Generators of different CPUs
+ * get different streams. Immediate injections use the same stream on
+ * every CPU so SEED makes them repeatable.
+ */
+void ki_seed_injection(struct ki_injection *injection)
+{
+        int cpu;
+
+        for_each_possible_cpu(cpu) {
+                struct ki_pcpu *pcpu = per_cpu_ptr(injection->pcpu, cpu);
+                u64 seed;
+
+                if (injection->seed)
+                        seed = injection->seed;
+                else
+                        get_random_bytes(&seed, sizeof(seed));
+                if (ki_is_triggered(injection)) seed += cpu;
+
+                /* Spread seed bits with splitmix64 finalizer */
+                seed += 0x9e3779b97f4a7c15ULL;
+                seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebULL;
+                seed ^= seed >> 31;
+                pcpu->rand = seed ? seed : 1;
+
+                if (injection->sched == KI_SCHED_EVERY)
+                        pcpu->countdown = injection->sched_arg;
+                else if (injection->sched == KI_SCHED_POISSON)
+                        pcpu->countdown = ki_rand_exp(pcpu, 
+                                                      injection->sched_arg);
+        }
+}
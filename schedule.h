@@ -0,0 +1,98 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_SCHEDULE_H
+#define KI_SCHEDULE_H
+
+#include <linux/atomic.h>
+#include <linux/percpu.h>
+#include "injection.h"
+
+/* --- RANDOM -------------------------------------------------------------- */
+/*
+ * Get next pseudo-random number from per CPU xorshift64* generator
+ */
+static inline u64 ki_rand(struct ki_pcpu *pcpu)
+{
+        u64 x = pcpu->rand;
+        x ^= x >> 12;
+        x ^= x << 25;
+        x ^= x >> 27;
+        pcpu->rand = x;
+        return x * 0x2545f4914f6cdd1dULL;
+}
+
+long ki_rand_exp(struct ki_pcpu *pcpu, u64 mean);
+void ki_seed_injection(struct ki_injection *injection);
+
+/* --- SCHEDULING ---------------------------------------------------------- */
+/*
+ * Check if injection is scheduled for this hit. Every CPU keeps its own
+ * schedule, so no state is shared between CPUs.
+ */
+static inline bool ki_sched_fire(struct ki_injection *injection,
+                                 struct ki_pcpu *pcpu)
+{
+        switch (injection->sched) {
+        case KI_SCHED_PROBABILITY:
+                return (ki_rand(pcpu) >> 32) < injection->sched_arg;
+        case KI_SCHED_EVERY:
+                if (--pcpu->countdown > 0) return false;
+                pcpu->countdown = injection->sched_arg;
+                return true;
+        case KI_SCHED_POISSON:
+                if (--pcpu->countdown > 0) return false;
+                pcpu->countdown = ki_rand_exp(pcpu, injection->sched_arg);
+                return true;
+        default:
+                return true;
+        }
+}
+
+/*
+ * Check injection limits and scheduling policy on a trigger hit. Must be
+ * called with preemption disabled.
+ * Returns true if injection should be executed.
+ */
+static inline bool ki_trigger_claim(struct ki_injection *injection,
+                                    struct ki_pcpu *pcpu)
+{
+        /* Handle injection limits. When budget is spent the shared
+         * counter is only read, so its cache line stays on all CPUs */
+        if (injection->max_inj && atomic64_read(&injection->budget) <= 0)
+                return false;
+
+        /* Handle skipped injections */
+        if (atomic64_read(&injection->skipped) > 0 &&
+            atomic64_dec_if_positive(&injection->skipped) >= 0)
+                return false;
+
+        /* Apply scheduling policy on this CPU */
+        if (!ki_sched_fire(injection, pcpu))
+                return false;
+
+        /* Claim one injection from the budget, other CPU may be faster */
+        if (injection->max_inj &&
+            atomic64_dec_if_positive(&injection->budget) < 0)
+                return false;
+
+        pcpu->calls++;
+        return true;
+}
+
+#endif /*KI_SCHEDULE_H*/
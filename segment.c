@@ -0,0 +1,317 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#include <linux/module.h>
+#include <linux/kallsyms.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include "segment.h"
+#include "profile.h"
+
+/* --- GLOBALS ------------------------------------------------------------- */
+static LIST_HEAD(ki_segments_list);
+static DEFINE_MUTEX(ki_segments_mutex);
+
+/* --- SEGMENT MAPS -------------------------------------------------------- */
+/*
+ * Find range of module symbols of given kallsyms types within lo and hi,
+ * module symbol table keeps symbol type in st_info.
+ * Returns the lowest symbol address or 0 if there is no such symbol.
+ */
+static unsigned long ki_seg_symbols(struct module *mod, const char *types,
+                                    unsigned long lo, unsigned long hi,
+                                    unsigned long *end)
+{
+        unsigned int i;
+        unsigned long start = 0;
+
+        *end = 0;
+        for (i = 0; i < mod->num_symtab; ++i) {
+                const Elf_Sym *sym = &mod->symtab[i];
+                unsigned long addr = sym->st_value;
+
+                if (!sym->st_info || !strchr(types, sym->st_info) ||
+                    addr < lo || addr >= hi)
+                        continue;
+
+                if (!start || addr < start) start = addr;
+                if (addr + sym->st_size > *end) *end = addr + sym->st_size;
+        }
+
+        return start;
+}
+
+/*
+ * Fill segments of a module. Init sections are included only before
+ * module is live, they are freed afterwards.
+ */
+static void ki_seg_module(struct ki_seg_map *map, struct module *mod,
+                          bool init)
+{
+        unsigned long core = (unsigned long) mod->module_core;
+        unsigned long rw = core + mod->core_ro_size;
+        unsigned long end = core + mod->core_size;
+        unsigned long bss, bss_end;
+
+        map->module = mod;
+
+        map->seg[KI_SEG_TEXT].start = core;
+        map->seg[KI_SEG_TEXT].size = mod->core_text_size;
+        map->seg[KI_SEG_RODATA].start = core + mod->core_text_size;
+        map->seg[KI_SEG_RODATA].size = mod->core_ro_size - 
+                                       mod->core_text_size;
+
+        /* Data and bss share writable part, bss starts at its first
+         * symbol */
+        bss = ki_seg_symbols(mod, "bB", rw, end, &bss_end);
+        map->seg[KI_SEG_DATA].start = rw;
+        map->seg[KI_SEG_DATA].size = (bss ? bss : end) - rw;
+        if (bss) {
+                map->seg[KI_SEG_BSS].start = bss;
+                map->seg[KI_SEG_BSS].size = bss_end - bss;
+        }
+
+        if (init && mod->module_init) {
+                map->seg[KI_SEG_INIT].start = (unsigned long) mod->module_init;
+                map->seg[KI_SEG_INIT].size = mod->init_size;
+        }
+
+#ifdef CONFIG_SMP
+        map->seg[KI_SEG_PERCPU].start = (unsigned long) mod->percpu;
+        map->seg[KI_SEG_PERCPU].size = mod->percpu_size;
+#endif
+}
+
+/*
+ * Fill segment from a pair of vmlinux symbols
+ */
+static void ki_seg_range(struct ki_segment *seg, const char *start,
+                         const char *end)
+{
+        unsigned long s = kallsyms_lookup_name(start);
+        unsigned long e = kallsyms_lookup_name(end);
+
+        if (e > s) {
+                seg->start = s;
+                seg->size = e - s;
+        }
+}
+
+/*
+ * Fill segments of vmlinux. Init sections are freed after boot.
+ */
+static void ki_seg_vmlinux(struct ki_seg_map *map)
+{
+        ki_seg_range(&map->seg[KI_SEG_TEXT], "_stext", "_etext");
+        ki_seg_range(&map->seg[KI_SEG_RODATA], "__start_rodata",
+                     "__end_rodata");
+        ki_seg_range(&map->seg[KI_SEG_DATA], "_sdata", "_edata");
+        ki_seg_range(&map->seg[KI_SEG_BSS], "__bss_start", "__bss_stop");
+        ki_seg_range(&map->seg[KI_SEG_PERCPU], "__per_cpu_start",
+                     "__per_cpu_end");
+}
+
+/*
+ * Allocate new segment table entry with a map
+ * Returns NULL if memory can't be allocated.
+ */
+static struct ki_segments *ki_segments_alloc(const char *name,
+                                             struct ki_seg_map **map)
+{
+        struct ki_segments *entry;
+
+        entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+        *map = kzalloc(sizeof(**map), GFP_KERNEL);
+        if (!entry || !*map) {
+                kfree(entry);
+                kfree(*map);
+                return NULL;
+        }
+
+        strlcpy(entry->name, name, sizeof(entry->name));
+        return entry;
+}
+
+/* --- FUNCTIONS ----------------------------------------------------------- */
+/*
+ * Get segment table entry of a loaded module or vmlinux. Entry is created
+ * on first use and is kept up to date by the module notifier.
+ * Returns NULL if module is not loaded.
+ */
+struct ki_segments *ki_segments_get(const char *name)
+{
+        struct module *mod;
+        struct ki_seg_map *map;
+        struct ki_segments *entry;
+
+        mutex_lock(&ki_segments_mutex);
+        list_for_each_entry(entry, &ki_segments_list, node) {
+                if (strcmp(entry->name, name) == 0) {
+                        if (!rcu_access_pointer(entry->map)) entry = NULL;
+                        goto out;
+                }
+        }
+
+        entry = NULL;
+        if (strlen(name) >= MODULE_NAME_LEN) goto out;
+
+        /* Module can't change its state while module_mutex is held */
+        mutex_lock(&module_mutex);
+        mod = find_module(name);
+        if (mod && mod->state != MODULE_STATE_GOING) {
+                entry = ki_segments_alloc(name, &map);
+                if (entry) {
+                        ki_seg_module(map, mod,
+                                      mod->state == MODULE_STATE_COMING);
+                        RCU_INIT_POINTER(entry->map, map);
+                        list_add(&entry->node, &ki_segments_list);
+                }
+        }
+        mutex_unlock(&module_mutex);
+
+out:
+        mutex_unlock(&ki_segments_mutex);
+        return entry;
+}
+
+/*
+ * Publish text profile of a module. Profile is rejected if module was
+ * reloaded since it was taken. Must be called from process context.
+ * Returns true if profile is owned by segment table now.
+ */
+bool ki_segments_set_profile(struct ki_segments *segments,
+                             struct ki_profile *profile)
+{
+        struct ki_seg_map *map;
+        struct ki_profile *old = NULL;
+        bool result = false;
+
+        mutex_lock(&ki_segments_mutex);
+        map = rcu_dereference_protected(segments->map,
+                        lockdep_is_held(&ki_segments_mutex));
+        if (map && map->seg[KI_SEG_TEXT].start == profile->start) {
+                old = rcu_dereference_protected(segments->profile,
+                                lockdep_is_held(&ki_segments_mutex));
+                rcu_assign_pointer(segments->profile, profile);
+                result = true;
+        }
+        mutex_unlock(&ki_segments_mutex);
+
+        if (old) {
+                synchronize_sched();
+                ki_profile_free(old);
+        }
+        return result;
+}
+
+/*
+ * Module notifier. Map is rebuilt when module comes and when it's live
+ * without init sections, it's removed when module goes. Old map is freed
+ * after injections using it are done, before module memory is freed.
+ */
+static int ki_segments_notify(struct notifier_block *nb, unsigned long action,
+                              void *data)
+{
+        struct module *mod = data;
+        struct ki_segments *entry;
+        struct ki_seg_map *map = NULL, *old;
+        struct ki_profile *profile = NULL;
+
+        if (action != MODULE_STATE_COMING && action != MODULE_STATE_LIVE &&
+            action != MODULE_STATE_GOING)
+                return NOTIFY_OK;
+
+        mutex_lock(&ki_segments_mutex);
+        list_for_each_entry(entry, &ki_segments_list, node) {
+                if (strcmp(entry->name, mod->name) != 0)
+                        continue;
+
+                /* Without memory module looks unloaded, which is safe */
+                if (action != MODULE_STATE_GOING) {
+                        map = kzalloc(sizeof(*map), GFP_KERNEL);
+                        if (map)
+                                ki_seg_module(map, mod,
+                                              action == MODULE_STATE_COMING);
+                }
+
+                /* Profile describes code which goes away */
+                if (action == MODULE_STATE_GOING) {
+                        profile = rcu_dereference_protected(entry->profile,
+                                        lockdep_is_held(&ki_segments_mutex));
+                        RCU_INIT_POINTER(entry->profile, NULL);
+                }
+
+                old = rcu_dereference_protected(entry->map,
+                                lockdep_is_held(&ki_segments_mutex));
+                rcu_assign_pointer(entry->map, map);
+                if (old || profile) {
+                        synchronize_sched();
+                        kfree(old);
+                        if (profile) ki_profile_free(profile);
+                }
+                break;
+        }
+        mutex_unlock(&ki_segments_mutex);
+
+        return NOTIFY_OK;
+}
+
+static struct notifier_block ki_segments_nb = {
+        .notifier_call = ki_segments_notify
+};
+
+/*
+ * Create vmlinux segment table entry and start tracking modules
+ */
+int ki_segments_init(void)
+{
+        int err;
+        struct ki_seg_map *map;
+        struct ki_segments *entry;
+
+        entry = ki_segments_alloc(KI_VMLINUX, &map);
+        if (!entry) return -ENOMEM;
+
+        ki_seg_vmlinux(map);
+        RCU_INIT_POINTER(entry->map, map);
+        list_add(&entry->node, &ki_segments_list);
+
+        err = register_module_notifier(&ki_segments_nb);
+        if (err) ki_segments_exit();
+        return err;
+}
+
+/*
+ * Stop tracking modules and free all entries. Injections must be freed
+ * already.
+ */
+void ki_segments_exit(void)
+{
+        struct ki_segments *entry, *tmp;
+
+        unregister_module_notifier(&ki_segments_nb);
+        list_for_each_entry_safe(entry, tmp, &ki_segments_list, node) {
+                list_del(&entry->node);
+                kfree(rcu_dereference_protected(entry->map, 1));
+                if (rcu_access_pointer(entry->profile))
+                        ki_profile_free(rcu_dereference_protected(
+                                        entry->profile, 1));
+                kfree(entry);
+        }
+}
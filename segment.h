@@ -0,0 +1,86 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_SEGMENT_H
+#define KI_SEGMENT_H
+
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/rcupdate.h>
+
+struct ki_profile;
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_VMLINUX "vmlinux"
+
+/* --- SEGMENT STRUCTURES -------------------------------------------------- */
+/*
+ * Segment kinds
+ */
+enum ki_seg_e
+{
+        KI_SEG_TEXT   = 0,
+        KI_SEG_RODATA = 1,
+        KI_SEG_DATA   = 2,
+        KI_SEG_BSS    = 3,
+        KI_SEG_INIT   = 4,      /* Init sections until module is live */
+        KI_SEG_PERCPU = 5,      /* Per CPU area template, see per_cpu_ptr */
+        KI_SEG_MAX    = 6
+};
+
+/*
+ * Memory segment, empty segments have zero size
+ */
+struct ki_segment
+{
+        unsigned long start;
+        unsigned long size;
+};
+
+/*
+ * Segments of a loaded module. Map is never modified, it's replaced when
+ * module state changes.
+ */
+struct ki_seg_map
+{
+        struct module     *module;      /* NULL for vmlinux */
+        struct ki_segment  seg[KI_SEG_MAX];
+};
+
+/*
+ * Segment table entry of a module name. Entries live until the injector
+ * is unloaded, so injections keep them across module reloads. Map is
+ * NULL when module is not loaded. Map and profile are read under
+ * RCU-sched, profile is dropped with the map it was taken from.
+ */
+struct ki_segments
+{
+        struct list_head          node;
+        struct ki_seg_map __rcu  *map;
+        struct ki_profile __rcu  *profile;  /* Text samples, may be NULL */
+        char                      name[MODULE_NAME_LEN];
+};
+
+/* --- SEGMENT FUNCTIONS --------------------------------------------------- */
+int ki_segments_init(void);
+void ki_segments_exit(void);
+struct ki_segments *ki_segments_get(const char *name);
+bool ki_segments_set_profile(struct ki_segments *segments,
+                             struct ki_profile *profile);
+
+#endif /*KI_SEGMENT_H*/
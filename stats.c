@@ -0,0 +1,214 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#include <linux/err.h>
+#include <linux/mutex.h>
+#include <linux/moduleparam.h>
+#include "stats.h"
+#include "injection.h"
+#include "kinjector.h"
+
+/* --- GLOBALS ------------------------------------------------------------- */
+static struct dentry *ki_stats_dir;    /* NULL without debugfs */
+struct static_key ki_stats_timing = STATIC_KEY_INIT_FALSE;
+static bool ki_timing;
+static bool ki_timing_ready;            /* Key can be switched */
+static DEFINE_MUTEX(ki_timing_mutex);   /* Protects both above */
+
+/* --- TIMING PARAMETER ---------------------------------------------------- */
+/*
+ * Switch timing key with the parameter. Key of a module being loaded is
+ * not ready yet, so value passed at load time is applied by init.
+ */
+static int ki_stats_set_timing(const char *val, const struct kernel_param *kp)
+{
+        bool old;
+        int ret;
+
+        mutex_lock(&ki_timing_mutex);
+        old = ki_timing;
+        ret = param_set_bool(val, kp);
+        if (!ret && ki_timing_ready && old != ki_timing) {
+                if (ki_timing) static_key_slow_inc(&ki_stats_timing);
+                else static_key_slow_dec(&ki_stats_timing);
+        }
+        mutex_unlock(&ki_timing_mutex);
+
+        return ret;
+}
+
+static const struct kernel_param_ops ki_timing_ops = {
+        .set = ki_stats_set_timing,
+        .get = param_get_bool
+};
+
+module_param_cb(timing, &ki_timing_ops, &ki_timing, 0644);
+MODULE_PARM_DESC(timing, "Measure handler and injection time histograms");
+
+/* --- STATISTICS FILE ----------------------------------------------------- */
+/*
+ * Time histograms of an injection
+ */
+enum ki_stats_hist_e
+{
+        KI_HIST_HANDLER,        /* Hit handler time */
+        KI_HIST_FLIP            /* Injection time */
+};
+
+/*
+ * Get histogram of a CPU
+ */
+static unsigned long *ki_stats_hist(struct ki_pcpu *pcpu,
+                                    enum ki_stats_hist_e hist)
+{
+        return hist == KI_HIST_HANDLER ? pcpu->handler_ns : pcpu->flip_ns;
+}
+
+/*
+ * Print non empty buckets of histograms summed over all CPUs
+ */
+static void ki_stats_show_hist(struct seq_file *s, const char *name,
+                               struct ki_injection *injection,
+                               enum ki_stats_hist_e which)
+{
+        int cpu;
+        unsigned int i;
+        unsigned long hist[KI_STATS_BUCKETS] = { 0 };
+
+        for_each_possible_cpu(cpu) {
+                unsigned long *pcpu_hist =
+                        ki_stats_hist(per_cpu_ptr(injection->pcpu, cpu), which);
+
+                for (i = 0; i < KI_STATS_BUCKETS; ++i)
+                        hist[i] += pcpu_hist[i];
+        }
+
+        for (i = 0; i < KI_STATS_BUCKETS; ++i)
+                if (hist[i])
+                        seq_printf(s, "%s %lluns %lu\n", name,
+                                   i ? 1ULL << i : 0ULL, hist[i]);
+}
+
+/*
+ * Show statistics of an injection. File keeps only injection id, so
+ * injection is looked up in the registry and can go away at any time.
+ */
+static int ki_stats_show(struct seq_file *s, void *v)
+{
+        int cpu, id = (long)s->private;
+        long hits = 0, rejected = 0, calls = 0;
+        struct ki_injection *injection;
+
+        rcu_read_lock();
+        injection = ki_registry_find(id);
+        if (!injection) {
+                rcu_read_unlock();
+                return -ENOENT;
+        }
+
+        for_each_possible_cpu(cpu) {
+                struct ki_pcpu *pcpu = per_cpu_ptr(injection->pcpu, cpu);
+
+                if (!pcpu->hits && !pcpu->calls) continue;
+                seq_printf(s, "CPU %d HITS %ld REJECTED %ld CALLS %ld\n",
+                           cpu, pcpu->hits, pcpu->rejected, pcpu->calls);
+                hits += pcpu->hits;
+                rejected += pcpu->rejected;
+                calls += pcpu->calls;
+        }
+        seq_printf(s, "TOTAL HITS %ld REJECTED %ld CALLS %ld\n", hits,
+                   rejected, calls);
+
+        ki_stats_show_hist(s, "HANDLER", injection, KI_HIST_HANDLER);
+        ki_stats_show_hist(s, "FLIP", injection, KI_HIST_FLIP);
+        rcu_read_unlock();
+
+        return 0;
+}
+
+/*
+ * Open statistics file of an injection
+ */
+static int ki_stats_open(struct inode *inode, struct file *file)
+{
+        return single_open(file, ki_stats_show, inode->i_private);
+}
+
+static const struct file_operations ki_stats_file_ops = {
+        .owner   = THIS_MODULE,
+        .open    = ki_stats_open,
+        .read    = seq_read,
+        .llseek  = seq_lseek,
+        .release = single_release
+};
+
+/* --- FUNCTIONS ----------------------------------------------------------- */
+/*
+ * Create statistics file of an injection published in the registry.
+ * Injection works without the file if it can't be created.
+ */
+void ki_stats_create(struct ki_injection *injection)
+{
+        char name[16];
+        struct dentry *file;
+
+        if (!ki_stats_dir) return;
+
+        snprintf(name, sizeof(name), "%d", injection->id);
+        file = debugfs_create_file(name, 0444, ki_stats_dir,
+                                   (void*)(long)injection->id,
+                                   &ki_stats_file_ops);
+        if (!IS_ERR_OR_NULL(file)) injection->stats = file;
+}
+
+/*
+ * Remove statistics file of an injection
+ */
+void ki_stats_remove(struct ki_injection *injection)
+{
+        debugfs_remove(injection->stats);
+        injection->stats = NULL;
+}
+
+/*
+ * Create debugfs directory, statistics are not available without debugfs.
+ * Timing requested at load time is switched on.
+ */
+void ki_stats_init(void)
+{
+        ki_stats_dir = debugfs_create_dir(MODULE_NAME_STR, NULL);
+        if (IS_ERR_OR_NULL(ki_stats_dir)) ki_stats_dir = NULL;
+
+        mutex_lock(&ki_timing_mutex);
+        if (ki_timing) static_key_slow_inc(&ki_stats_timing);
+        ki_timing_ready = true;
+        mutex_unlock(&ki_timing_mutex);
+}
+
+/*
+ * Remove debugfs directory. Called after all injections are gone.
+ */
+void ki_stats_exit(void)
+{
+        debugfs_remove_recursive(ki_stats_dir);
+}
@@ -0,0 +1,57 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_STATS_H
+#define KI_STATS_H
+
+#include <linux/types.h>
+#include <linux/log2.h>
+#include <linux/kernel.h>
+#include <linux/jump_label.h>
+#include "injection.h"
+
+/* --- GLOBALS ------------------------------------------------------------- */
+extern struct static_key ki_stats_timing;
+
+/* --- STATISTICS UTILITY FUNCTIONS ---------------------------------------- */
+/*
+ * Check if handler and injection times are measured. It's a not taken
+ * branch unless timing parameter is set.
+ */
+static inline bool ki_stats_timed(void)
+{
+        return static_key_false(&ki_stats_timing);
+}
+
+/*
+ * Count time in a log2 histogram, bucket n holds [2^n, 2^(n+1)) ns
+ */
+static inline void ki_stats_time(unsigned long *hist, u64 ns)
+{
+        unsigned int bucket = ns ? ilog2(ns) : 0;
+
+        hist[min_t(unsigned int, bucket, KI_STATS_BUCKETS - 1)]++;
+}
+
+/* --- STATISTICS FUNCTIONS ------------------------------------------------ */
+void ki_stats_init(void);
+void ki_stats_exit(void);
+void ki_stats_create(struct ki_injection *injection);
+void ki_stats_remove(struct ki_injection *injection);
+
+#endif /*KI_STATS_H*/
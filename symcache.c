@@ -0,0 +1,158 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+
+#include <linux/module.h>
+#include <linux/kallsyms.h>
+#include <linux/hashtable.h>
+#include <linux/dcache.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include "symcache.h"
+#include "kinjector.h"
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_SYMCACHE_BITS 10
+#define KI_SYMCACHE_MAX 4096    /* Entries cached at most */
+
+/* --- STRUCTURES ---------------------------------------------------------- */
+/*
+ * Cached symbol. Missing symbols are not cached, so names written by
+ * anybody can't fill memory.
+ */
+struct ki_symcache_entry
+{
+        struct hlist_node node;
+        unsigned long     addr;
+        struct module    *owner;  /* NULL for vmlinux */
+        char              name[];
+};
+
+/* --- GLOBALS ------------------------------------------------------------- */
+static DEFINE_HASHTABLE(ki_symcache, KI_SYMCACHE_BITS);
+static DEFINE_MUTEX(ki_symcache_mutex);
+static unsigned int ki_symcache_count;
+
+/* --- FUNCTIONS ----------------------------------------------------------- */
+/*
+ * Resolve symbol address, kallsyms is asked only once per found name
+ * until the cache is full. Symbols of modules being unloaded are not
+ * cached: their state is set before the notifier drops their entries,
+ * which waits for the cache mutex held here.
+ * Returns 0 if symbol doesn't exist.
+ */
+unsigned long ki_symcache_lookup(const char *name)
+{
+        u32 hash;
+        size_t len;
+        unsigned long addr;
+        struct ki_symcache_entry *entry;
+
+        len = strlen(name);
+        hash = full_name_hash(name, len);
+
+        mutex_lock(&ki_symcache_mutex);
+        hash_for_each_possible(ki_symcache, entry, node, hash) {
+                if (strcmp(entry->name, name) == 0) {
+                        addr = entry->addr;
+                        goto out;
+                }
+        }
+
+        addr = kallsyms_lookup_name(name);
+        if (!addr || ki_symcache_count >= KI_SYMCACHE_MAX) goto out;
+
+        entry = kmalloc(sizeof(*entry) + len + 1, GFP_KERNEL);
+        if (!entry) goto out;
+
+        memcpy(entry->name, name, len + 1);
+        entry->addr = addr;
+        preempt_disable();
+        entry->owner = __module_address(addr);
+        if (entry->owner && entry->owner->state == MODULE_STATE_GOING) {
+                preempt_enable();
+                kfree(entry);
+                goto out;
+        }
+        preempt_enable();
+        hash_add(ki_symcache, &entry->node, hash);
+        ki_symcache_count++;
+
+out:
+        mutex_unlock(&ki_symcache_mutex);
+        return addr;
+}
+
+/*
+ * Drop cached entries belonging to the owner module
+ */
+static void ki_symcache_drop(struct module *owner)
+{
+        int bkt;
+        struct hlist_node *tmp;
+        struct ki_symcache_entry *entry;
+
+        mutex_lock(&ki_symcache_mutex);
+        hash_for_each_safe(ki_symcache, bkt, tmp, entry, node) {
+                if (entry->owner == owner) {
+                        hash_del(&entry->node);
+                        kfree(entry);
+                        ki_symcache_count--;
+                }
+        }
+        mutex_unlock(&ki_symcache_mutex);
+}
+
+/*
+ * Module notifier. Unloaded module takes its symbols away.
+ */
+static int ki_symcache_notify(struct notifier_block *nb, unsigned long action,
+                              void *data)
+{
+        if (action == MODULE_STATE_GOING) ki_symcache_drop(data);
+
+        return NOTIFY_OK;
+}
+
+static struct notifier_block ki_symcache_nb = {
+        .notifier_call = ki_symcache_notify
+};
+
+/*
+ * Start tracking modules
+ */
+int ki_symcache_init(void)
+{
+        return register_module_notifier(&ki_symcache_nb);
+}
+
+/*
+ * Stop tracking modules and free all entries
+ */
+void ki_symcache_exit(void)
+{
+        int bkt;
+        struct hlist_node *tmp;
+        struct ki_symcache_entry *entry;
+
+        unregister_module_notifier(&ki_symcache_nb);
+        hash_for_each_safe(ki_symcache, bkt, tmp, entry, node) {
+                hash_del(&entry->node);
+                kfree(entry);
+        }
+}
@@ -0,0 +1,204 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM kernelinjector
+
+#if !defined(KI_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define KI_TRACE_H
+
+#include <linux/tracepoint.h>
+#include "injection.h"
+
+/* --- TRACEPOINTS --------------------------------------------------------- */
+/*
+ * Batch of commands written to procfs
+ */
+TRACE_EVENT(ki_command,
+        TP_PROTO(size_t len, size_t count),
+        TP_ARGS(len, count),
+        TP_STRUCT__entry(
+                __field(size_t, len)
+                __field(size_t, count)
+        ),
+        TP_fast_assign(
+                __entry->len   = len;
+                __entry->count = count;
+        ),
+        TP_printk("len=%zu count=%zu", __entry->len, __entry->count)
+);
+
+/*
+ * Command of a batch which failed to parse, pos is the column of error
+ */
+TRACE_EVENT(ki_parse_error,
+        TP_PROTO(size_t line, size_t pos, const char *msg),
+        TP_ARGS(line, pos, msg),
+        TP_STRUCT__entry(
+                __field(size_t, line)
+                __field(size_t, pos)
+                __string(msg, msg)
+        ),
+        TP_fast_assign(
+                __entry->line = line;
+                __entry->pos  = pos;
+                __assign_str(msg, msg);
+        ),
+        TP_printk("line=%zu pos=%zu msg=%s", __entry->line, __entry->pos,
+                  __get_str(msg))
+);
+
+/*
+ * Result of injection validation
+ */
+TRACE_EVENT(ki_validate,
+        TP_PROTO(struct ki_injection *injection, bool ok, const char *msg),
+        TP_ARGS(injection, ok, msg),
+        TP_STRUCT__entry(
+                __field(unsigned long, target)
+                __field(unsigned long, trigger)
+                __field(unsigned int, flags)
+                __field(bool, ok)
+                __string(msg, msg)
+        ),
+        TP_fast_assign(
+                __entry->target  = injection->target.addr;
+                __entry->trigger = injection->trigger.addr;
+                __entry->flags   = injection->flags;
+                __entry->ok      = ok;
+                __assign_str(msg, msg);
+        ),
+        TP_printk("target=0x%lx trigger=0x%lx flags=0x%x ok=%d msg=%s",
+                  __entry->target, __entry->trigger, __entry->flags,
+                  __entry->ok, __get_str(msg))
+);
+
+/*
+ * Injection attached to its trigger probe, mode is enum
+ * ki_trigger_mode_e. Shared is set when the probe was already registered
+ * for another injection.
+ */
+TRACE_EVENT(ki_probe_arm,
+        TP_PROTO(int id, unsigned long addr, int mode, bool shared, bool ok),
+        TP_ARGS(id, addr, mode, shared, ok),
+        TP_STRUCT__entry(
+                __field(int, id)
+                __field(unsigned long, addr)
+                __field(int, mode)
+                __field(bool, shared)
+                __field(bool, ok)
+        ),
+        TP_fast_assign(
+                __entry->id     = id;
+                __entry->addr   = addr;
+                __entry->mode   = mode;
+                __entry->shared = shared;
+                __entry->ok     = ok;
+        ),
+        TP_printk("id=%d addr=%pS mode=%d shared=%d ok=%d", __entry->id,
+                  (void *)__entry->addr, __entry->mode, __entry->shared,
+                  __entry->ok)
+);
+
+/*
+ * Injection detached from its trigger probe, last is set when the probe
+ * was unregistered with it
+ */
+TRACE_EVENT(ki_probe_disarm,
+        TP_PROTO(int id, unsigned long addr, int mode, bool last),
+        TP_ARGS(id, addr, mode, last),
+        TP_STRUCT__entry(
+                __field(int, id)
+                __field(unsigned long, addr)
+                __field(int, mode)
+                __field(bool, last)
+        ),
+        TP_fast_assign(
+                __entry->id   = id;
+                __entry->addr = addr;
+                __entry->mode = mode;
+                __entry->last = last;
+        ),
+        TP_printk("id=%d addr=%pS mode=%d last=%d", __entry->id,
+                  (void *)__entry->addr, __entry->mode, __entry->last)
+);
+
+/*
+ * Injection executed, trigger is 0 for immediate injections
+ */
+TRACE_EVENT(ki_inject,
+        TP_PROTO(struct ki_injection *injection),
+        TP_ARGS(injection),
+        TP_STRUCT__entry(
+                __field(int, id)
+                __field(unsigned long, trigger)
+                __field(unsigned long, target)
+        ),
+        TP_fast_assign(
+                __entry->id      = injection->id;
+                __entry->trigger = injection->trigger.addr ?
+                                   injection->trigger.addr + 
+                                   injection->trigger_offset : 0;
+                __entry->target  = injection->target.addr ?
+                                   injection->target.addr +
+                                   injection->target_offset : 0;
+        ),
+        TP_printk("id=%d trigger=0x%lx target=0x%lx", __entry->id,
+                  __entry->trigger, __entry->target)
+);
+
+/*
+ * Word modified by an injection, type is enum ki_record_type_e. Nothing
+ * is written in DEBUG mode.
+ */
+TRACE_EVENT(ki_flip,
+        TP_PROTO(struct ki_injection *injection, int type, unsigned long addr,
+                 unsigned int size, u64 mask),
+        TP_ARGS(injection, type, addr, size, mask),
+        TP_STRUCT__entry(
+                __field(int, id)
+                __field(int, type)
+                __field(unsigned long, addr)
+                __field(unsigned int, size)
+                __field(u64, mask)
+                __field(int, fault)
+                __field(bool, debug)
+        ),
+        TP_fast_assign(
+                __entry->id    = injection->id;
+                __entry->type  = type;
+                __entry->addr  = addr;
+                __entry->size  = size;
+                __entry->mask  = mask;
+                __entry->fault = injection->fault;
+                __entry->debug = injection->debug;
+        ),
+        TP_printk("id=%d type=%d addr=0x%lx size=%u mask=0x%llx fault=%d "
+                  "debug=%d", __entry->id, __entry->type, __entry->addr,
+                  __entry->size, __entry->mask, __entry->fault,
+                  __entry->debug)
+);
+
+#endif /*KI_TRACE_H*/
+
+/* --- TRACEPOINT DEFINITIONS ---------------------------------------------- */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE trace
+#include <trace/define_trace.h>
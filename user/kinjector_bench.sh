@@ -0,0 +1,53 @@
+#!/bin/sh
+# Measure trigger overhead of kernelinjector with kinjector_bench.ko.
+# Run as root in the source directory of a test VM after `make && make bench`.
+# Every measurement is run with 1, 2, 4... threads up to THREADS, without
+# triggers first and then with a DEBUG trigger of every trigger mode.
+# With TRACING=1 every mode is measured again with all kernelinjector
+# tracepoints enabled.
+
+set -e
+
+THREADS=${THREADS:-$(nproc)}
+DURATION_MS=${DURATION_MS:-1000}
+RATE=${RATE:-0}
+MODES=${MODES:-"KPROBE FTRACE"}
+TRACING=${TRACING:-0}
+EVENTS=/sys/kernel/debug/tracing/events/kernelinjector/enable
+PROC=/proc/kernelinjector
+BENCH=/proc/kinjector_bench
+
+[ -e $PROC ] || insmod ./kernelinjector.ko
+insmod ./kinjector_bench.ko duration_ms=$DURATION_MS rate=$RATE
+trap 'echo CLEAR > $PROC; rmmod kinjector_bench' EXIT
+
+# Print result of every thread count prefixed by a label
+run() {
+        n=1
+        while :; do
+                echo $n > $BENCH
+                echo "$1 $(cat $BENCH)"
+                [ $n -ge $THREADS ] && break
+                n=$((n * 2))
+                [ $n -gt $THREADS ] && n=$THREADS
+        done
+}
+
+run BASELINE
+for mode in $MODES; do
+        echo "TRIGGER ki_bench_target TRIGGER_MODE $mode" \
+             "INJECT_INTO ki_bench_data BITFLIP 1 DEBUG" > $PROC
+        status=$(head -n 1 $PROC)
+        case "$status" in
+        *OK*)
+                run $mode
+                if [ "$TRACING" = 1 ]; then
+                        echo 1 > $EVENTS
+                        run $mode-TRACING
+                        echo 0 > $EVENTS
+                fi
+                ;;
+        *) echo "$mode $status" ;;
+        esac
+        echo CLEAR > $PROC
+done
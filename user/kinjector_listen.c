@@ -0,0 +1,374 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+/*
+ * Listen to injection events multicast by the kernelinjector generic
+ * netlink family. Raw netlink is used, so no library is needed: family
+ * and its events group are resolved through the generic netlink
+ * controller. Every message is printed as one line, injection records
+ * can also be written to a binary records file read by kinjector_replay.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include "records.h"
+#include "netlink.h"
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_LISTEN_BUF 65536
+
+#ifndef SOL_NETLINK
+#define SOL_NETLINK 270
+#endif
+
+/* --- STRUCTURES ---------------------------------------------------------- */
+/*
+ * Attributes of one generic netlink message by type
+ */
+struct ki_listen_attrs
+{
+        const struct nlattr *attr[KI_NL_A_MAX + 1];
+};
+
+/* --- NETLINK HELPERS ----------------------------------------------------- */
+/*
+ * Get first attribute of a generic netlink message
+ */
+static struct nlattr *ki_listen_first(struct nlmsghdr *nlh)
+{
+        return (struct nlattr*) ((char*) NLMSG_DATA(nlh) + GENL_HDRLEN);
+}
+
+/*
+ * Index attributes of a buffer by type, unknown types are ignored
+ */
+static void ki_listen_parse(const struct nlattr *nla, int len,
+                            const struct nlattr **attr, int max)
+{
+        memset(attr, 0, (max + 1) * sizeof(*attr));
+        while (len >= (int) NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN &&
+               nla->nla_len <= len) {
+                int type = nla->nla_type & NLA_TYPE_MASK;
+
+                if (type <= max) attr[type] = nla;
+                len -= NLA_ALIGN(nla->nla_len);
+                nla = (const struct nlattr*) ((const char*) nla + 
+                                              NLA_ALIGN(nla->nla_len));
+        }
+}
+
+/*
+ * Get payload of an attribute
+ */
+static const void *ki_listen_data(const struct nlattr *nla)
+{
+        return (const char*) nla + NLA_HDRLEN;
+}
+
+/*
+ * Get u32 attribute, 0 if missing
+ */
+static __u32 ki_listen_u32(const struct nlattr *nla)
+{
+        __u32 value = 0;
+        if (nla) memcpy(&value, ki_listen_data(nla), sizeof(value));
+        return value;
+}
+
+/*
+ * Get u64 attribute, 0 if missing
+ */
+static __u64 ki_listen_u64(const struct nlattr *nla)
+{
+        __u64 value = 0;
+        if (nla) memcpy(&value, ki_listen_data(nla), sizeof(value));
+        return value;
+}
+
+/*
+ * Append an attribute to a message being built
+ */
+static void ki_listen_put(struct nlmsghdr *nlh, int type, const void *data,
+                          int len)
+{
+        struct nlattr *nla = (struct nlattr*) ((char*) nlh + 
+                                               NLMSG_ALIGN(nlh->nlmsg_len));
+
+        nla->nla_type = type;
+        nla->nla_len = NLA_HDRLEN + len;
+        memcpy((char*) nla + NLA_HDRLEN, data, len);
+        nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLA_ALIGN(nla->nla_len);
+}
+
+/* --- RESOLVING ----------------------------------------------------------- */
+/*
+ * Find id of the family and of its events group in a controller reply
+ * Returns 0 on success.
+ */
+static int ki_listen_family(struct nlmsghdr *nlh, int *family, int *group)
+{
+        const struct nlattr *attr[CTRL_ATTR_MAX + 1];
+        const struct nlattr *grp[CTRL_ATTR_MCAST_GRP_MAX + 1];
+        const struct nlattr *nla;
+        int len;
+
+        if (nlh->nlmsg_type == NLMSG_ERROR) {
+                struct nlmsgerr *err = NLMSG_DATA(nlh);
+                return err->error ? err->error : -ENOENT;
+        }
+
+        ki_listen_parse(ki_listen_first(nlh), 
+                        nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN),
+                        attr, CTRL_ATTR_MAX);
+        if (!attr[CTRL_ATTR_FAMILY_ID] || !attr[CTRL_ATTR_MCAST_GROUPS])
+                return -ENOENT;
+        *family = *(const __u16*) ki_listen_data(attr[CTRL_ATTR_FAMILY_ID]);
+
+        /* Groups are nested in a nested array */
+        nla = ki_listen_data(attr[CTRL_ATTR_MCAST_GROUPS]);
+        len = attr[CTRL_ATTR_MCAST_GROUPS]->nla_len - NLA_HDRLEN;
+        while (len >= (int) NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN &&
+               nla->nla_len <= len) {
+                ki_listen_parse(ki_listen_data(nla), nla->nla_len - NLA_HDRLEN,
+                                grp, CTRL_ATTR_MCAST_GRP_MAX);
+                if (grp[CTRL_ATTR_MCAST_GRP_NAME] && 
+                    grp[CTRL_ATTR_MCAST_GRP_ID] &&
+                    !strcmp(ki_listen_data(grp[CTRL_ATTR_MCAST_GRP_NAME]),
+                            KI_NL_GROUP_NAME)) {
+                        *group = ki_listen_u32(grp[CTRL_ATTR_MCAST_GRP_ID]);
+                        return 0;
+                }
+                len -= NLA_ALIGN(nla->nla_len);
+                nla = (const struct nlattr*) ((const char*) nla + 
+                                              NLA_ALIGN(nla->nla_len));
+        }
+
+        return -ENOENT;
+}
+
+/*
+ * Open netlink socket subscribed to the events group
+ * Returns socket or negative errno.
+ */
+static int ki_listen_open(int *family)
+{
+        struct sockaddr_nl addr;
+        struct nlmsghdr *nlh;
+        struct genlmsghdr *genl;
+        char buf[4096] __attribute__((aligned(NLMSG_ALIGNTO)));
+        int fd, group, ret;
+        ssize_t len;
+
+        fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
+        if (fd < 0) return -errno;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.nl_family = AF_NETLINK;
+        if (bind(fd, (struct sockaddr*) &addr, sizeof(addr))) goto fail;
+
+        /* Ask controller for the family */
+        memset(buf, 0, sizeof(buf));
+        nlh = (struct nlmsghdr*) buf;
+        nlh->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+        nlh->nlmsg_type = GENL_ID_CTRL;
+        nlh->nlmsg_flags = NLM_F_REQUEST;
+        nlh->nlmsg_seq = 1;
+        genl = NLMSG_DATA(nlh);
+        genl->cmd = CTRL_CMD_GETFAMILY;
+        genl->version = 1;
+        ki_listen_put(nlh, CTRL_ATTR_FAMILY_NAME, KI_NL_FAMILY_NAME,
+                      sizeof(KI_NL_FAMILY_NAME));
+
+        memset(&addr, 0, sizeof(addr));
+        addr.nl_family = AF_NETLINK;
+        if (sendto(fd, buf, nlh->nlmsg_len, 0, (struct sockaddr*) &addr,
+                   sizeof(addr)) < 0)
+                goto fail;
+
+        len = recv(fd, buf, sizeof(buf), 0);
+        if (len < 0) goto fail;
+        if (!NLMSG_OK(nlh, len)) {
+                close(fd);
+                return -EPROTO;
+        }
+
+        ret = ki_listen_family(nlh, family, &group);
+        if (ret) {
+                close(fd);
+                return ret;
+        }
+
+        if (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group,
+                       sizeof(group)))
+                goto fail;
+        return fd;
+
+fail:
+        ret = -errno;
+        close(fd);
+        return ret;
+}
+
+/* --- PRINTING ------------------------------------------------------------ */
+/*
+ * Fill injection record from message attributes
+ */
+static void ki_listen_record(const struct nlattr **attr,
+                             struct ki_record *rec)
+{
+        memset(rec, 0, sizeof(*rec));
+        rec->timestamp = ki_listen_u64(attr[KI_NL_A_TIMESTAMP]);
+        rec->trigger = ki_listen_u64(attr[KI_NL_A_TRIGGER]);
+        rec->addr = ki_listen_u64(attr[KI_NL_A_ADDR]);
+        rec->mask = ki_listen_u64(attr[KI_NL_A_MASK]);
+        rec->id = ki_listen_u32(attr[KI_NL_A_ID]);
+        rec->cpu = ki_listen_u32(attr[KI_NL_A_CPU]);
+        rec->type = ki_listen_u32(attr[KI_NL_A_TYPE]);
+        rec->bit = ki_listen_u32(attr[KI_NL_A_BIT]);
+        rec->reg = ki_listen_u32(attr[KI_NL_A_REG]);
+        rec->size = ki_listen_u32(attr[KI_NL_A_SIZE]);
+        rec->fault = ki_listen_u32(attr[KI_NL_A_FAULT]);
+        rec->hit = ki_listen_u64(attr[KI_NL_A_HIT]);
+        rec->offset = ki_listen_u64(attr[KI_NL_A_OFFSET]);
+}
+
+/*
+ * Print one event and write its record
+ * Returns 0 on success.
+ */
+static int ki_listen_event(struct nlmsghdr *nlh, FILE *out)
+{
+        const struct nlattr *attr[KI_NL_A_MAX + 1];
+        struct genlmsghdr *genl = NLMSG_DATA(nlh);
+        struct ki_record rec;
+
+        ki_listen_parse(ki_listen_first(nlh),
+                        nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN),
+                        attr, KI_NL_A_MAX);
+
+        if (genl->cmd == KI_NL_C_RESULT) {
+                printf("RESULT POS %u ID %u %s\n",
+                       ki_listen_u32(attr[KI_NL_A_POS]),
+                       ki_listen_u32(attr[KI_NL_A_ID]),
+                       attr[KI_NL_A_MSG] ? 
+                       (const char*) ki_listen_data(attr[KI_NL_A_MSG]) : "");
+                return 0;
+        }
+        if (genl->cmd != KI_NL_C_INJECTION) return 0;
+
+        ki_listen_record(attr, &rec);
+        printf("INJECTION %llu ID %u CPU %u TYPE %u HIT %llu "
+               "ADDR 0x%llx MASK 0x%llx SIZE %u OFFSET 0x%llx\n",
+               (unsigned long long) rec.timestamp, rec.id, rec.cpu, rec.type,
+               (unsigned long long) rec.hit, (unsigned long long) rec.addr,
+               (unsigned long long) rec.mask, rec.size, 
+               (unsigned long long) rec.offset);
+
+        if (out && fwrite(&rec, sizeof(rec), 1, out) != 1) return -EIO;
+        return 0;
+}
+
+static void ki_listen_usage(const char *name)
+{
+        fprintf(stderr, 
+                "Usage: %s [-n count] [-r records_file]\n"
+                "  -n  exit after count events\n"
+                "  -r  write binary injection records to a file\n"
+                "Prints events of the kernelinjector netlink family.\n",
+                name);
+}
+
+int main(int argc, char **argv)
+{
+        const char *records_path = NULL;
+        unsigned long count = 0, events = 0;
+        char *buf;
+        FILE *out = NULL;
+        int opt, fd, family, ret = 0;
+
+        while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+                switch (opt) {
+                case 'n': count = strtoul(optarg, NULL, 10); break;
+                case 'r': records_path = optarg; break;
+                default:
+                        ki_listen_usage(argv[0]);
+                        return 2;
+                }
+        }
+        if (optind != argc) {
+                ki_listen_usage(argv[0]);
+                return 2;
+        }
+
+        buf = malloc(KI_LISTEN_BUF);
+        if (!buf) {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+        }
+
+        fd = ki_listen_open(&family);
+        if (fd < 0) {
+                fprintf(stderr, "%s: %s\n", KI_NL_FAMILY_NAME, strerror(-fd));
+                return 1;
+        }
+
+        if (records_path) {
+                out = fopen(records_path, "wb");
+                if (!out) {
+                        perror(records_path);
+                        return 1;
+                }
+        }
+
+        setvbuf(stdout, NULL, _IOLBF, 0);
+        while (!ret && (!count || events < count)) {
+                struct nlmsghdr *nlh = (struct nlmsghdr*) buf;
+                ssize_t len = recv(fd, buf, KI_LISTEN_BUF, 0);
+
+                if (len < 0) {
+                        /* Events were dropped by a full socket buffer */
+                        if (errno == ENOBUFS) {
+                                printf("OVERRUN\n");
+                                continue;
+                        }
+                        if (errno == EINTR) continue;
+                        ret = -errno;
+                        break;
+                }
+
+                for (; !ret && NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len))
+                        if (nlh->nlmsg_type == family) {
+                                ret = ki_listen_event(nlh, out);
+                                if (++events == count) break;
+                        }
+        }
+
+        if (ret) fprintf(stderr, "%s\n", strerror(-ret));
+        if (out && fclose(out)) {
+                perror(records_path);
+                ret = -EIO;
+        }
+        close(fd);
+        free(buf);
+        return ret ? 1 : 0;
+}
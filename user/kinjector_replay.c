@@ -0,0 +1,134 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+/*
+ * Build a REPLAY command from a records file written by kinjector_run.
+ * Records of one injection are appended as REPLAY keywords to a command
+ * with the same trigger and places, so recorded modifications are
+ * repeated at the same hits. Command is printed with one write, so output
+ * can be redirected to the command file.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "libkinjector.h"
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_REPLAY_KEYWORD 96    /* Longest REPLAY keyword */
+
+/* --- HELPERS ------------------------------------------------------------- */
+/*
+ * Append a string and a separator to a growing line
+ * Returns 0 on success.
+ */
+static int ki_replay_append(char **line, size_t *len, size_t *size,
+                            const char *str)
+{
+        size_t n = strlen(str) + 1;
+        char *new_line;
+
+        if (*len + n + 1 > *size) {
+                *size = (*len + n + 1) * 2;
+                new_line = realloc(*line, *size);
+                if (!new_line) return -ENOMEM;
+                *line = new_line;
+        }
+
+        memcpy(*line + *len, str, n - 1);
+        (*line)[*len + n - 1] = ' ';
+        *len += n;
+        return 0;
+}
+
+static void ki_replay_usage(const char *name)
+{
+        fprintf(stderr, 
+                "Usage: %s -i id records_file command...\n"
+                "  -i  id of recorded injection\n"
+                "Prints command followed by REPLAY keywords of records.\n"
+                "Command is the recorded one without FAULT, STACK, REGS,\n"
+                "segment, limit and scheduling keywords. BITFLIP is kept\n"
+                "for TARGET records.\n",
+                name);
+}
+
+int main(int argc, char **argv)
+{
+        struct ki_record record;
+        char keyword[KI_REPLAY_KEYWORD];
+        unsigned long id = 0;
+        size_t replayed = 0;
+        char *line = NULL;
+        size_t len = 0, size = 0;
+        ssize_t done;
+        FILE *file;
+        int opt, i, ret = 0;
+
+        while ((opt = getopt(argc, argv, "i:")) != -1) {
+                switch (opt) {
+                case 'i': id = strtoul(optarg, NULL, 10); break;
+                default:
+                        ki_replay_usage(argv[0]);
+                        return 2;
+                }
+        }
+        if (!id || optind + 2 > argc) {
+                ki_replay_usage(argv[0]);
+                return 2;
+        }
+
+        file = strcmp(argv[optind], "-") ? fopen(argv[optind], "rb") : stdin;
+        if (!file) {
+                perror(argv[optind]);
+                return 1;
+        }
+
+        for (i = optind + 1; !ret && i < argc; ++i)
+                ret = ki_replay_append(&line, &len, &size, argv[i]);
+
+        while (!ret && fread(&record, sizeof(record), 1, file) == 1) {
+                if (record.id != id ||
+                    ki_record_replay(&record, keyword, sizeof(keyword)) < 0)
+                        continue;
+                ret = ki_replay_append(&line, &len, &size, keyword);
+                ++replayed;
+        }
+        if (file != stdin) fclose(file);
+
+        if (ret) {
+                fprintf(stderr, "%s\n", strerror(-ret));
+        } else if (!replayed) {
+                fprintf(stderr, "No records of injection %lu\n", id);
+                ret = 1;
+        } else {
+                /* Last separator ends the command */
+                line[len - 1] = '\n';
+                do {
+                        done = write(STDOUT_FILENO, line, len);
+                } while (done < 0 && errno == EINTR);
+                if (done != (ssize_t)len) {
+                        perror("write");
+                        ret = 1;
+                }
+        }
+
+        free(line);
+        return ret ? 1 : 0;
+}
@@ -0,0 +1,372 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+/*
+ * Campaign runner. Commands of a campaign file are submitted in batches
+ * with optional pacing, failures are reported with their line and column,
+ * injection records are streamed to a file and counters of armed
+ * injections are collected at the end.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "libkinjector.h"
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_RUN_BATCH   256      /* Default commands per batch */
+#define KI_RUN_RECORDS 4096     /* Records taken by one read */
+#define KI_RUN_POLL_MS 100      /* Records polling while waiting */
+
+/* --- STRUCTURES ---------------------------------------------------------- */
+/*
+ * Runner options and totals
+ */
+struct ki_run
+{
+        const char      *path;
+        size_t           batch;
+        unsigned int     interval_ms;
+        unsigned int     wait_ms;
+        int              remove;
+        FILE            *records_out;
+        int              records_fd;
+        struct ki_record *records;
+        struct ki_client client;
+        struct ki_result *results;
+        size_t          *lines;         /* Campaign line of batch commands */
+        int             *ids;           /* Armed injections */
+        size_t           armed;
+        size_t           commands;
+        size_t           failed;
+        size_t           recorded;
+};
+
+/* --- HELPERS ------------------------------------------------------------- */
+static double ki_run_now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void ki_run_sleep(unsigned int ms)
+{
+        struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+
+        while (nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+/*
+ * Move all pending records to the output file
+ * Returns 0 on success.
+ */
+static int ki_run_drain(struct ki_run *run)
+{
+        ssize_t count;
+
+        if (!run->records_out) return 0;
+
+        while ((count = ki_records_read(run->records_fd, run->records,
+                                        KI_RUN_RECORDS)) > 0) {
+                if (fwrite(run->records, sizeof(*run->records), count,
+                           run->records_out) != (size_t)count)
+                        return -EIO;
+                run->recorded += count;
+        }
+
+        return count < 0 ? count : 0;
+}
+
+/*
+ * Submit collected batch and report its failures
+ * Returns 0 on success.
+ */
+static int ki_run_submit(struct ki_run *run)
+{
+        size_t i, count = run->client.count;
+        int failed;
+
+        if (!count) return 0;
+
+        failed = ki_client_submit(&run->client, run->results);
+        if (failed < 0) return failed;
+
+        for (i = 0; i < count; ++i) {
+                struct ki_result *result = &run->results[i];
+
+                if (!result->ok)
+                        fprintf(stderr, "%s:%zu:%lu: %s\n", run->path,
+                                run->lines[i], result->pos, result->msg);
+                else if (result->id) {
+                        int *ids = realloc(run->ids, (run->armed + 1) *
+                                                     sizeof(*ids));
+                        if (!ids) return -ENOMEM;
+                        run->ids = ids;
+                        run->ids[run->armed++] = result->id;
+                }
+        }
+
+        run->commands += count;
+        run->failed += failed;
+        return ki_run_drain(run);
+}
+
+static int ki_run_cmp_id(const void *a, const void *b)
+{
+        return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * Print counters of armed injections
+ * Returns 0 on success.
+ */
+static int ki_run_report(struct ki_run *run)
+{
+        size_t i, j, count;
+        struct ki_entry *entries;
+        int ret;
+
+        ret = ki_client_list(&run->client, &entries, &count);
+        if (ret) return ret;
+
+        /* Listing is ordered by id, ids wrap around when allocated */
+        qsort(run->ids, run->armed, sizeof(*run->ids), ki_run_cmp_id);
+        for (i = 0, j = 0; i < run->armed && j < count; ) {
+                struct ki_entry *entry = &entries[j];
+
+                if (entry->id < run->ids[i]) { ++j; continue; }
+                if (entry->id > run->ids[i]) { ++i; continue; }
+
+                printf("ID %d CALLS %ld/%ld%s", entry->id, entry->calls,
+                       entry->max, entry->finished ? " FINISHED" : "");
+                if (entry->outcome)
+                        printf(" RETURNED %ld ERRORS %ld LATENCY %lluns"
+                               " MISSED %ld",
+                               entry->returned, entry->errors,
+                               entry->latency, entry->missed);
+                putchar('\n');
+                ++i;
+                ++j;
+        }
+
+        free(entries);
+        return 0;
+}
+
+/*
+ * Remove injections armed by the campaign
+ * Returns 0 on success.
+ */
+static int ki_run_remove(struct ki_run *run)
+{
+        size_t i;
+        int ret;
+
+        for (i = 0; i < run->armed; ++i) {
+                ret = ki_client_add(&run->client, "REMOVE %d", run->ids[i]);
+                if (ret) return ret;
+                if (run->client.count == run->batch || i + 1 == run->armed) {
+                        ret = ki_client_submit(&run->client, run->results);
+                        if (ret < 0) return ret;
+                }
+        }
+
+        return 0;
+}
+
+/*
+ * Find SHOW keyword in a command. SHOW changes the listing of all
+ * clients until the next write, so counters couldn't be collected.
+ * Returns column of the keyword, -1 if there is none.
+ */
+static long ki_run_find_show(const char *command)
+{
+        const char *p = command;
+
+        while (*p) {
+                size_t len = strcspn(p, " \t");
+
+                if (len == 4 && !strncmp(p, "SHOW", 4)) return p - command;
+                p += len;
+                p += strspn(p, " \t");
+        }
+
+        return -1;
+}
+
+/*
+ * Submit campaign file in batches
+ * Returns 0 on success.
+ */
+static int ki_run_file(struct ki_run *run, FILE *file)
+{
+        char *line = NULL;
+        size_t size = 0, number = 0;
+        ssize_t len;
+        long show;
+        int ret = 0;
+
+        while ((len = getline(&line, &size, file)) >= 0) {
+                char *p = line;
+
+                ++number;
+                while (*p == ' ' || *p == '\t') ++p;
+                p[strcspn(p, "\r\n")] = '\0';
+                if (!*p || *p == '#') continue;
+
+                show = ki_run_find_show(p);
+                if (show >= 0) {
+                        fprintf(stderr, "%s:%zu:%ld: SHOW is not allowed in "
+                                "campaign file\n", run->path, number,
+                                show + (long) (p - line));
+                        run->commands++;
+                        run->failed++;
+                        continue;
+                }
+
+                ret = ki_client_add(&run->client, "%s", p);
+                if (ret) break;
+                run->lines[run->client.count - 1] = number;
+
+                if (run->client.count < run->batch) continue;
+                ret = ki_run_submit(run);
+                if (ret) break;
+                if (run->interval_ms) ki_run_sleep(run->interval_ms);
+        }
+
+        if (!ret) ret = ki_run_submit(run);
+        free(line);
+        return ret;
+}
+
+static void ki_run_usage(const char *name)
+{
+        fprintf(stderr, 
+                "Usage: %s [-b batch] [-i interval_ms] [-w wait_ms] "
+                "[-r records_file] [-c] campaign_file\n"
+                "  -b  commands submitted together (default %d)\n"
+                "  -i  pause between batches\n"
+                "  -w  time to collect records after last batch\n"
+                "  -r  write binary injection records to a file\n"
+                "  -c  remove armed injections at the end\n"
+                "Campaign file has one command per line, '-' is stdin.\n",
+                name, KI_RUN_BATCH);
+}
+
+int main(int argc, char **argv)
+{
+        struct ki_run run;
+        const char *records_path = NULL;
+        double start, elapsed;
+        unsigned int waited;
+        FILE *file;
+        int opt, ret;
+
+        memset(&run, 0, sizeof(run));
+        run.batch = KI_RUN_BATCH;
+        run.records_fd = -1;
+
+        while ((opt = getopt(argc, argv, "b:i:w:r:c")) != -1) {
+                switch (opt) {
+                case 'b': run.batch = strtoul(optarg, NULL, 10); break;
+                case 'i': run.interval_ms = strtoul(optarg, NULL, 10); break;
+                case 'w': run.wait_ms = strtoul(optarg, NULL, 10); break;
+                case 'r': records_path = optarg; break;
+                case 'c': run.remove = 1; break;
+                default:
+                        ki_run_usage(argv[0]);
+                        return 2;
+                }
+        }
+        if (optind + 1 != argc || !run.batch) {
+                ki_run_usage(argv[0]);
+                return 2;
+        }
+        run.path = argv[optind];
+
+        file = strcmp(run.path, "-") ? fopen(run.path, "r") : stdin;
+        if (!file) {
+                perror(run.path);
+                return 1;
+        }
+
+        run.results = calloc(run.batch, sizeof(*run.results));
+        run.lines = calloc(run.batch, sizeof(*run.lines));
+        run.records = calloc(KI_RUN_RECORDS, sizeof(*run.records));
+        if (!run.results || !run.lines || !run.records) {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+        }
+
+        ret = ki_client_open(&run.client);
+        if (ret) {
+                fprintf(stderr, "%s: %s\n", KI_PROC_FILE, strerror(-ret));
+                return 1;
+        }
+
+        if (records_path) {
+                run.records_fd = ki_records_open();
+                if (run.records_fd < 0) {
+                        fprintf(stderr, "%s: %s\n", KI_RECORDS_FILE,
+                                strerror(-run.records_fd));
+                        return 1;
+                }
+                run.records_out = fopen(records_path, "wb");
+                if (!run.records_out) {
+                        perror(records_path);
+                        return 1;
+                }
+                /* Records of earlier injections are not collected */
+                while (ki_records_read(run.records_fd, run.records,
+                                       KI_RUN_RECORDS) > 0);
+        }
+
+        start = ki_run_now();
+        ret = ki_run_file(&run, file);
+        elapsed = ki_run_now() - start;
+
+        for (waited = 0; !ret && waited < run.wait_ms; 
+             waited += KI_RUN_POLL_MS) {
+                ki_run_sleep(KI_RUN_POLL_MS);
+                ret = ki_run_drain(&run);
+        }
+
+        if (!ret) ret = ki_run_report(&run);
+        if (!ret && run.remove) ret = ki_run_remove(&run);
+        if (!ret) ret = ki_run_drain(&run);
+        if (ret) fprintf(stderr, "%s\n", strerror(-ret));
+
+        printf("COMMANDS %zu FAILED %zu ARMED %zu RECORDS %zu "
+               "TIME %.3fs RATE %.0f/s\n", run.commands, run.failed,
+               run.armed, run.recorded, elapsed, 
+               elapsed > 0 ? run.commands / elapsed : 0.0);
+
+        if (run.records_out) fclose(run.records_out);
+        if (run.records_fd >= 0) close(run.records_fd);
+        if (file != stdin) fclose(file);
+        ki_client_close(&run.client);
+        free(run.ids);
+        free(run.records);
+        free(run.lines);
+        free(run.results);
+        return ret || run.failed ? 1 : 0;
+}
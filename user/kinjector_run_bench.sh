@@ -0,0 +1,27 @@
+#!/bin/sh
+# Measure command submission rate of kinjector_run against batch size.
+# Run as root in the source directory of a test VM after `make && make tools`.
+# COMMANDS DEBUG injections triggered by TRIGGER are submitted with every
+# batch size of BATCHES and removed again, RATE of each run is printed.
+
+set -e
+
+COMMANDS=${COMMANDS:-10000}
+BATCHES=${BATCHES:-"1 4 16 64 256 1024"}
+TRIGGER=${TRIGGER:-vfs_getattr}
+PROC=/proc/kernelinjector
+CAMPAIGN=$(mktemp)
+
+[ -e $PROC ] || insmod ./kernelinjector.ko
+trap 'rm -f $CAMPAIGN; echo CLEAR > $PROC' EXIT
+
+# Same probe is shared by all injections, so the rate is that of commands
+n=0
+while [ $n -lt $COMMANDS ]; do
+        echo "TRIGGER $TRIGGER EVERY 1000000 INJECT_INTO $TRIGGER BITFLIP 1 DEBUG"
+        n=$((n + 1))
+done > $CAMPAIGN
+
+for batch in $BATCHES; do
+        echo "BATCH $batch $(./user/kinjector_run -b $batch -c $CAMPAIGN | tail -n 1)"
+done
@@ -0,0 +1,77 @@
+#!/bin/sh
+# Stress injection registry of kernelinjector with kinjector_bench.ko.
+# Run as root in the source directory of a test VM after `make && make bench`.
+# WRITERS processes arm, REMOVE and CLEAR injections, READERS processes list
+# them and THREADS kernel threads hit their trigger, all at the same time for
+# DURATION seconds. Fails if the kernel log gets a BUG, WARNING or KASAN
+# report or the command file stops answering.
+
+set -e
+
+WRITERS=${WRITERS:-4}
+READERS=${READERS:-2}
+THREADS=${THREADS:-$(nproc)}
+DURATION=${DURATION:-10}
+PROC=/proc/kernelinjector
+BENCH=/proc/kinjector_bench
+
+[ -e $PROC ] || insmod ./kernelinjector.ko
+insmod ./kinjector_bench.ko duration_ms=$((DURATION * 1000))
+trap 'echo CLEAR > $PROC; rmmod kinjector_bench' EXIT
+
+log_start=$(dmesg | wc -l)
+end=$(($(date +%s) + DURATION))
+
+# Arm a batch of injections sharing one probe, remove a listed one and
+# clear everything now and then. Failed commands are expected, other
+# writers remove injections at the same time.
+writer() {
+        i=0
+        while [ $(date +%s) -lt $end ]; do
+                printf '%s\n' \
+                    "TRIGGER ki_bench_target TRIGGER_MODE KPROBE INJECT_INTO ki_bench_data BITFLIP 1 DEBUG" \
+                    "TRIGGER ki_bench_target TRIGGER_MODE FTRACE INJECT_INTO ki_bench_data BITFLIP 1 DEBUG" \
+                    "TRIGGER ki_bench_target OUTCOME INJECT_INTO ki_bench_data BITFLIP 1 DEBUG" \
+                    "TRIGGER ki_bench_target INJECT_INTO ki_bench_data BITFLIP 1 EVERY 3 DEBUG" \
+                    > $PROC 2>/dev/null || true
+                id=$(sed -n 's/.* ID \([0-9]*\).*/\1/p' $PROC | tail -n 1)
+                [ -n "$id" ] && { echo "REMOVE $id" > $PROC 2>/dev/null || true; }
+                i=$((i + 1))
+                [ $((i % 16)) -eq 0 ] && { echo CLEAR > $PROC 2>/dev/null || true; }
+        done
+}
+
+reader() {
+        while [ $(date +%s) -lt $end ]; do
+                cat $PROC > /dev/null
+        done
+}
+
+echo $THREADS > $BENCH &
+pids=$!
+n=0
+while [ $n -lt $WRITERS ]; do writer & pids="$pids $!"; n=$((n + 1)); done
+n=0
+while [ $n -lt $READERS ]; do reader & pids="$pids $!"; n=$((n + 1)); done
+for pid in $pids; do wait $pid; done
+
+# Registry must still work and the log must be clean
+echo CLEAR > $PROC
+echo "TRIGGER ki_bench_target INJECT_INTO ki_bench_data BITFLIP 1 DEBUG" > $PROC
+status=$(head -n 1 $PROC)
+echo CLEAR > $PROC
+reports=$(dmesg | tail -n +$((log_start + 1)) |
+          grep -E 'BUG|WARNING|KASAN|general protection' || true)
+
+echo "WRITERS $WRITERS READERS $READERS THREADS $THREADS DURATION ${DURATION}s"
+echo "$(cat $BENCH)"
+case "$status" in
+*OK*) ;;
+*) echo "FAILED $status"; exit 1 ;;
+esac
+if [ -n "$reports" ]; then
+        echo "$reports"
+        echo FAILED
+        exit 1
+fi
+echo PASSED
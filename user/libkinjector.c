@@ -0,0 +1,364 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+/*
+ * User space client of /proc/kernelinjector. Commands are collected in one
+ * buffer and written with a single write, only status lines of the batch
+ * are read back.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "libkinjector.h"
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_BATCH_SIZE 65536     /* Initial size of buffers */
+
+/* --- BUFFERS ------------------------------------------------------------- */
+/*
+ * Make room for len more bytes in a buffer
+ * Returns 0 on success.
+ */
+static int ki_reserve(char **buf, size_t *size, size_t used, size_t len)
+{
+        size_t new_size = *size ? *size : KI_BATCH_SIZE;
+        char *new_buf;
+
+        if (used + len <= *size) return 0;
+        while (new_size < used + len) new_size *= 2;
+
+        new_buf = realloc(*buf, new_size);
+        if (!new_buf) return -ENOMEM;
+        *buf = new_buf;
+        *size = new_size;
+        return 0;
+}
+
+/*
+ * Read command file from the beginning until lines lines are read or
+ * file ends. Listing can be long, so reading stops as soon as possible.
+ * Returns number of bytes read or negative errno.
+ */
+static ssize_t ki_read_lines(struct ki_client *client, size_t lines)
+{
+        size_t len = 0, found = 0;
+
+        if (lseek(client->fd, 0, SEEK_SET) < 0) return -errno;
+
+        for (;;) {
+                ssize_t done;
+                char *p;
+
+                if (ki_reserve(&client->read_buf, &client->read_size, len,
+                               KI_BATCH_SIZE / 2 + 1))
+                        return -ENOMEM;
+
+                done = read(client->fd, client->read_buf + len,
+                            client->read_size - len - 1);
+                if (done < 0 && errno == EINTR) continue;
+                if (done < 0) return -errno;
+                if (done == 0) break;
+
+                for (p = client->read_buf + len; 
+                     (p = memchr(p, '\n', client->read_buf + len + done - p));
+                     ++p)
+                        ++found;
+                len += done;
+                if (lines && found >= lines) break;
+        }
+
+        client->read_buf[len] = '\0';
+        return len;
+}
+
+/* --- PARSING ------------------------------------------------------------- */
+/*
+ * Parse status line "pos: message" or "pos: message ID id"
+ * Returns 0 on success.
+ */
+int ki_parse_result(const char *line, struct ki_result *result)
+{
+        char *end, *id, *p;
+        size_t len;
+
+        result->pos = strtoul(line, &end, 10);
+        if (end == line || end[0] != ':' || end[1] != ' ') return -EINVAL;
+        line = end + 2;
+
+        len = strcspn(line, "\n");
+        if (len >= KI_MSG_LEN) len = KI_MSG_LEN - 1;
+        memcpy(result->msg, line, len);
+        result->msg[len] = '\0';
+
+        /* Id is reported only for armed injections, after the message */
+        result->id = 0;
+        for (id = NULL, p = result->msg; (p = strstr(p, " ID ")); ++p)
+                id = p;
+        if (id) {
+                long value = strtol(id + 4, &end, 10);
+                if (end != id + 4 && !*end) {
+                        result->id = value;
+                        *id = '\0';
+                }
+        }
+
+        result->ok = !strcmp(result->msg, "OK");
+        return 0;
+}
+
+/*
+ * Parse listing line of an injection. Words are matched by name, so
+ * optional parts of the line can be missing.
+ * Returns 0 on success.
+ */
+int ki_parse_entry(const char *line, struct ki_entry *entry)
+{
+        const char *p = line;
+
+        memset(entry, 0, sizeof(*entry));
+        if (!strncmp(line, "TRIGGER ", 8)) entry->kind = KI_ENTRY_TRIGGER;
+        else if (!strncmp(line, "TIMER ", 6)) entry->kind = KI_ENTRY_TIMER;
+        else if (!strncmp(line, "CAMPAIGN ", 9)) 
+                entry->kind = KI_ENTRY_CAMPAIGN;
+        else if (!strncmp(line, "PROFILE ", 8)) 
+                entry->kind = KI_ENTRY_PROFILE;
+        else return -EINVAL;
+
+        while (*p && *p != '\n') {
+                if (!strncmp(p, "FINISHED ", 9))
+                        entry->finished = 1;
+                else if (!strncmp(p, "CALLS ", 6))
+                        sscanf(p + 6, "%ld/%ld", &entry->calls, &entry->max);
+                else if (!strncmp(p, "SAMPLES ", 8))
+                        sscanf(p + 8, "%ld", &entry->calls);
+                else if (!strncmp(p, "ID ", 3))
+                        sscanf(p + 3, "%d", &entry->id);
+                else if (!strncmp(p, "RETURNED ", 9)) {
+                        entry->outcome = 1;
+                        sscanf(p + 9, "%ld", &entry->returned);
+                }
+                else if (!strncmp(p, "ERRORS ", 7))
+                        sscanf(p + 7, "%ld", &entry->errors);
+                else if (!strncmp(p, "LATENCY ", 8))
+                        sscanf(p + 8, "%llu", &entry->latency);
+                else if (!strncmp(p, "MISSED ", 7))
+                        sscanf(p + 7, "%ld", &entry->missed);
+
+                /* Next word */
+                while (*p && *p != ' ' && *p != '\n') ++p;
+                while (*p == ' ') ++p;
+        }
+
+        return entry->id ? 0 : -EINVAL;
+}
+
+/* --- CLIENT -------------------------------------------------------------- */
+/*
+ * Open command file
+ * Returns 0 on success.
+ */
+int ki_client_open(struct ki_client *client)
+{
+        memset(client, 0, sizeof(*client));
+        client->fd = open(KI_PROC_FILE, O_RDWR | O_CLOEXEC);
+        return client->fd < 0 ? -errno : 0;
+}
+
+/*
+ * Close command file and free buffers
+ */
+void ki_client_close(struct ki_client *client)
+{
+        if (client->fd >= 0) close(client->fd);
+        free(client->batch);
+        free(client->read_buf);
+        memset(client, 0, sizeof(*client));
+        client->fd = -1;
+}
+
+/*
+ * Add one command to the batch
+ * Returns 0 on success.
+ */
+int ki_client_add(struct ki_client *client, const char *fmt, ...)
+{
+        va_list args;
+        int len;
+
+        va_start(args, fmt);
+        len = vsnprintf(NULL, 0, fmt, args);
+        va_end(args);
+        if (len <= 0) return -EINVAL;
+
+        if (ki_reserve(&client->batch, &client->size, client->len, len + 2))
+                return -ENOMEM;
+
+        va_start(args, fmt);
+        vsnprintf(client->batch + client->len, len + 1, fmt, args);
+        va_end(args);
+
+        /* One command is one line */
+        if (memchr(client->batch + client->len, '\n', len)) return -EINVAL;
+
+        client->len += len;
+        client->batch[client->len++] = '\n';
+        client->count++;
+        return 0;
+}
+
+/*
+ * Write the batch and read status of every command into results, which
+ * must hold as many elements as commands were added. Batch is emptied.
+ * Returns number of failed commands or negative errno.
+ */
+int ki_client_submit(struct ki_client *client, struct ki_result *results)
+{
+        size_t i, count = client->count;
+        ssize_t done;
+        char *line;
+        int failed = 0;
+
+        if (!count) return 0;
+
+        /* Whole batch must be written at once to be executed together */
+        do {
+                done = write(client->fd, client->batch, client->len);
+        } while (done < 0 && errno == EINTR);
+        client->len = 0;
+        client->count = 0;
+        if (done < 0) return -errno;
+
+        done = ki_read_lines(client, count);
+        if (done < 0) return done;
+
+        line = client->read_buf;
+        for (i = 0; i < count; ++i) {
+                if (!*line || ki_parse_result(line, &results[i])) 
+                        return -EPROTO;
+                if (!results[i].ok) ++failed;
+
+                line += strcspn(line, "\n");
+                if (*line) ++line;
+        }
+
+        return failed;
+}
+
+/*
+ * Read listing of all injections. Entries are allocated and must be freed
+ * by caller. Listing is limited to one injection after SHOW command.
+ * Returns 0 on success.
+ */
+int ki_client_list(struct ki_client *client, struct ki_entry **entries,
+                   size_t *count)
+{
+        size_t size = 0;
+        ssize_t done;
+        char *line;
+
+        *entries = NULL;
+        *count = 0;
+
+        done = ki_read_lines(client, 0);
+        if (done < 0) return done;
+
+        for (line = client->read_buf; *line; ) {
+                struct ki_entry entry;
+
+                /* Status lines start with a column number */
+                if (!ki_parse_entry(line, &entry)) {
+                        if (*count == size) {
+                                struct ki_entry *new_entries;
+
+                                size = size ? size * 2 : 64;
+                                new_entries = realloc(*entries, 
+                                                      size * sizeof(entry));
+                                if (!new_entries) {
+                                        free(*entries);
+                                        *entries = NULL;
+                                        *count = 0;
+                                        return -ENOMEM;
+                                }
+                                *entries = new_entries;
+                        }
+                        (*entries)[(*count)++] = entry;
+                }
+
+                line += strcspn(line, "\n");
+                if (*line) ++line;
+        }
+
+        return 0;
+}
+
+/* --- RECORDS ------------------------------------------------------------- */
+/*
+ * Open records file
+ * Returns file descriptor or negative errno.
+ */
+int ki_records_open(void)
+{
+        int fd = open(KI_RECORDS_FILE, O_RDONLY | O_CLOEXEC);
+        return fd < 0 ? -errno : fd;
+}
+
+/*
+ * Take up to count records. Reading never blocks, records of all CPUs
+ * are taken in one call.
+ * Returns number of records or negative errno.
+ */
+ssize_t ki_records_read(int fd, struct ki_record *records, size_t count)
+{
+        ssize_t done;
+
+        do {
+                done = read(fd, records, count * sizeof(*records));
+        } while (done < 0 && errno == EINTR);
+
+        return done < 0 ? -errno : done / (ssize_t)sizeof(*records);
+}
+
+/*
+ * Format a record as REPLAY keyword repeating its modification. Only
+ * records of trigger hits can be replayed.
+ * Returns length of the keyword as snprintf or negative errno.
+ */
+int ki_record_replay(const struct ki_record *record, char *buf, size_t len)
+{
+        static const char *types[] = {
+                [KI_REC_TARGET] = "TARGET", [KI_REC_STACK]  = "STACK",
+                [KI_REC_REGS]   = "REGS",   [KI_REC_DATA]   = "DATA",
+                [KI_REC_RODATA] = "RODATA", [KI_REC_CODE]   = "CODE",
+                [KI_REC_BSS]    = "BSS",    [KI_REC_INIT]   = "INIT",
+                [KI_REC_PERCPU] = "PERCPU"
+        };
+
+        if (record->type >= sizeof(types) / sizeof(types[0]) ||
+            !types[record->type] || !record->hit || !record->mask)
+                return -EINVAL;
+
+        return snprintf(buf, len, "REPLAY %u:%llu:%s:0x%llx:%u:0x%llx",
+                        record->cpu, (unsigned long long)record->hit,
+                        types[record->type],
+                        (unsigned long long)record->offset, record->size,
+                        (unsigned long long)record->mask);
+}
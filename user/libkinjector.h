@@ -0,0 +1,104 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_LIBKINJECTOR_H
+#define KI_LIBKINJECTOR_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "records.h"
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_PROC_FILE    "/proc/kernelinjector"
+#define KI_RECORDS_FILE "/proc/kernelinjector_records"
+#define KI_MSG_LEN      128
+
+/* --- STRUCTURES ---------------------------------------------------------- */
+/*
+ * Connection to the command file with a batch being built. Results of a
+ * batch are shared by all writers, so one process should submit at a time.
+ */
+struct ki_client
+{
+        int     fd;
+        char   *batch;          /* Commands separated by new lines */
+        size_t  len;
+        size_t  size;
+        size_t  count;          /* Commands in batch */
+        char   *read_buf;       /* Listing read from the command file */
+        size_t  read_size;
+};
+
+/*
+ * Status line of one command
+ */
+struct ki_result
+{
+        unsigned long pos;      /* Column of last parsed keyword */
+        int           id;       /* Id of armed injection, 0 if none */
+        int           ok;       /* Command succeeded */
+        char          msg[KI_MSG_LEN];
+};
+
+/*
+ * Kinds of listed injections
+ */
+enum ki_entry_e
+{
+        KI_ENTRY_TRIGGER  = 0,
+        KI_ENTRY_TIMER    = 1,
+        KI_ENTRY_CAMPAIGN = 2,
+        KI_ENTRY_PROFILE  = 3
+};
+
+/*
+ * Listing line of one injection
+ */
+struct ki_entry
+{
+        enum ki_entry_e kind;
+        int             id;
+        int             finished;   /* Campaign or profile is done */
+        long            calls;      /* Injections or profile samples */
+        long            max;        /* MAX_INJECTIONS or CAMPAIGN */
+        int             outcome;    /* OUTCOME counters are listed */
+        long            returned;   /* OUTCOME counters */
+        long            errors;
+        unsigned long long latency; /* Average latency in ns */
+        long            missed;     /* Hits missed by the return probe */
+};
+
+/* --- CLIENT FUNCTIONS ---------------------------------------------------- */
+int ki_client_open(struct ki_client *client);
+void ki_client_close(struct ki_client *client);
+int ki_client_add(struct ki_client *client, const char *fmt, ...)
+        __attribute__((format(printf, 2, 3)));
+int ki_client_submit(struct ki_client *client, struct ki_result *results);
+int ki_client_list(struct ki_client *client, struct ki_entry **entries,
+                   size_t *count);
+
+/* --- PARSING FUNCTIONS --------------------------------------------------- */
+int ki_parse_result(const char *line, struct ki_result *result);
+int ki_parse_entry(const char *line, struct ki_entry *entry);
+
+/* --- RECORD FUNCTIONS ---------------------------------------------------- */
+int ki_records_open(void);
+ssize_t ki_records_read(int fd, struct ki_record *records, size_t count);
+int ki_record_replay(const struct ki_record *record, char *buf, size_t len);
+
+#endif /*KI_LIBKINJECTOR_H*/
@@ -0,0 +1,154 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+/*
+ * Userspace benchmark of command parsing and validation. Commands are
+ * handled the same way as a batch written to /proc/kernelinjector, with
+ * symbol and module lookups replaced by stubs of stubs.c.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "parser.h"
+#include "injection.h"
+#include "stubs.h"
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_BENCH_COMMANDS 100000
+#define KI_BENCH_ROUNDS   10
+
+/* --- GLOBALS ------------------------------------------------------------- */
+static const char *ki_bench_commands[] = {
+        "TRIGGER do_fork INJECT_INTO jiffies BITFLIP 1 MAX_INJECTIONS 10",
+        "TRIGGER 0xffffffff81000000 TRIGGER_OFFSET 4 TRIGGER_MODE KPROBE "
+        "STACK PROBABILITY 0.001",
+        "MODULE ext4 DATA RODATA BSS FAULT BITS 3 SEED 42",
+        "TRIGGER_TIMER 1000000 TIMER_JITTER 1000 TIMER_PERCPU MODULE ext4 "
+        "CODE HOT MAX_INJECTIONS 100",
+        "CAMPAIGN 1000 INTERVAL 100 DURATION 1000 MODULE vmlinux PERCPU "
+        "FAULT XOR 0xff",
+        "TRIGGER vfs_read OUTCOME REGS EVERY 100 SKIPPED_INJECTIONS 5 DEBUG",
+        "PROFILE 1000 MODULE ext4",
+        "TRIGGER vfs_read MODULE ext4 REPLAY 0:12:DATA:0x1a0:8:0x10 "
+        "REPLAY 1:40:REGS:0x50:8:0x4",
+        "SHOW 1",
+        "REMOVE 3"
+};
+
+/* --- BENCHMARK ----------------------------------------------------------- */
+/*
+ * Build a batch of count commands, one per line
+ */
+static char *ki_bench_batch(size_t count, size_t *len)
+{
+        size_t i, pos = 0, size = 0;
+        size_t templates = sizeof(ki_bench_commands) / 
+                           sizeof(ki_bench_commands[0]);
+        char *batch;
+
+        for (i = 0; i < count; ++i)
+                size += strlen(ki_bench_commands[i % templates]) + 1;
+
+        batch = malloc(size + 1);
+        if (!batch) return NULL;
+
+        for (i = 0; i < count; ++i) {
+                const char *command = ki_bench_commands[i % templates];
+                size_t command_len = strlen(command);
+
+                memcpy(batch + pos, command, command_len);
+                pos += command_len;
+                batch[pos++] = '\n';
+        }
+        batch[pos] = '\0';
+
+        *len = pos;
+        return batch;
+}
+
+/*
+ * Parse and validate every line of a batch.
+ * Returns number of failed commands.
+ */
+static size_t ki_bench_run(char *batch, size_t len)
+{
+        size_t start = 0, end, pos, failed = 0;
+        struct ki_injection injection;
+        char *msg;
+
+        while (start < len) {
+                for (end = start; end < len && batch[end] != '\n'; ++end);
+
+                ki_init_injection(&injection);
+                if (!ki_parse(batch + start, end - start, &pos, &injection,
+                              &msg) ||
+                    !ki_validate_injection(&injection, &msg)) {
+                        if (!failed)
+                                fprintf(stderr, "%.*s\n%zu: %s\n",
+                                        (int)(end - start), batch + start,
+                                        pos, msg);
+                        ++failed;
+                }
+                ki_stubs_free(&injection);
+
+                start = end + 1;
+        }
+
+        return failed;
+}
+
+int main(int argc, char **argv)
+{
+        size_t len, failed = 0, commands = KI_BENCH_COMMANDS;
+        int i, rounds = KI_BENCH_ROUNDS;
+        struct timespec start, stop;
+        double elapsed;
+        char *batch;
+
+        if (argc > 1) commands = strtoul(argv[1], NULL, 10);
+        if (argc > 2) rounds = atoi(argv[2]);
+        if (!commands || rounds <= 0) {
+                fprintf(stderr, "Usage: %s [commands] [rounds]\n", argv[0]);
+                return 1;
+        }
+
+        batch = ki_bench_batch(commands, &len);
+        if (!batch) {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < rounds; ++i)
+                failed += ki_bench_run(batch, len);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+
+        elapsed = (stop.tv_sec - start.tv_sec) +
+                  (stop.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%zu commands x %d rounds, %zu bytes per batch\n",
+               commands, rounds, len);
+        printf("%.0f commands/s, %.1f ns/command, %.1f MB/s\n",
+               commands * rounds / elapsed,
+               elapsed * 1e9 / (commands * rounds),
+               len * rounds / elapsed / 1e6);
+        if (failed) printf("%zu commands failed\n", failed);
+
+        free(batch);
+        return failed ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+/*
+ * libFuzzer harness of command parsing and validation. Input is split into
+ * commands like a write to /proc/kernelinjector and every command is
+ * copied to a buffer of its exact size followed by its terminator, so
+ * sanitizers catch reads past the command. Without libFuzzer a main
+ * reading inputs from files is built with KI_FUZZ_MAIN.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parser.h"
+#include "injection.h"
+#include "stubs.h"
+
+/* --- FUZZING ------------------------------------------------------------- */
+/*
+ * Parse and validate one command of len bytes followed by terminator
+ */
+static void ki_fuzz_command(const uint8_t *data, size_t len, char terminator)
+{
+        struct ki_injection injection;
+        char *buffer, *msg;
+        size_t pos;
+
+        buffer = malloc(len + 1);
+        if (!buffer) return;
+        memcpy(buffer, data, len);
+        buffer[len] = terminator;
+
+        ki_init_injection(&injection);
+        if (ki_parse(buffer, len, &pos, &injection, &msg))
+                ki_validate_injection(&injection, &msg);
+        if (pos > len) abort();
+        ki_stubs_free(&injection);
+        free(buffer);
+}
+
+/*
+ * Commands are lines, the last one is terminated by NUL as in ki_write
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+        size_t start = 0, end;
+
+        while (start < size) {
+                for (end = start; end < size && data[end] != '\n'; ++end);
+                ki_fuzz_command(data + start, end - start,
+                                end < size ? '\n' : '\0');
+                start = end + 1;
+        }
+
+        return 0;
+}
+
+#ifdef KI_FUZZ_MAIN
+/*
+ * Run inputs of files given as arguments, or of stdin
+ */
+int main(int argc, char **argv)
+{
+        int i;
+
+        for (i = 1; i < argc || i == 1; ++i) {
+                FILE *file = i < argc ? fopen(argv[i], "rb") : stdin;
+                uint8_t *data = NULL;
+                size_t size = 0, done;
+                uint8_t chunk[4096];
+
+                if (!file) {
+                        perror(argv[i]);
+                        return 1;
+                }
+                while ((done = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+                        uint8_t *grown = realloc(data, size + done);
+                        if (!grown) return 1;
+                        data = grown;
+                        memcpy(data + size, chunk, done);
+                        size += done;
+                }
+                if (file != stdin) fclose(file);
+
+                LLVMFuzzerTestOneInput(data, size);
+                free(data);
+        }
+
+        return 0;
+}
+#endif
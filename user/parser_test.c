@@ -0,0 +1,560 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+/*
+ * Tests of command parsing, validation and selection of trigger hits.
+ * Parser, validator and scheduling code of the module are built in user
+ * space with stubs of stubs.c. Every failed check is reported with its
+ * line and the test exits with non-zero status.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "parser.h"
+#include "injection.h"
+#include "schedule.h"
+#include "stubs.h"
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_CHECK(cond, ...) \
+        do { \
+                ++ki_checks; \
+                if (!(cond)) { \
+                        ++ki_failures; \
+                        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+                        fprintf(stderr, __VA_ARGS__); \
+                        fprintf(stderr, "\n"); \
+                } \
+        } while (0)
+
+#define KI_TEST_BATCH    100000 /* Commands of the large batch */
+#define KI_TEST_MIN_RATE 100000 /* Commands/s, parser_bench gets ~2M */
+
+/* --- STRUCTURES ---------------------------------------------------------- */
+/*
+ * Command with expected result of parsing and validation
+ */
+struct ki_test_case
+{
+        const char *command;
+        const char *msg;
+};
+
+/* --- GLOBALS ------------------------------------------------------------- */
+static unsigned int ki_checks;
+static unsigned int ki_failures;
+
+/*
+ * Every keyword accepted and rejected
+ */
+static const struct ki_test_case ki_keyword_cases[] = {
+        { "CLEAR", "OK" },
+        { "REMOVE 3", "OK" },
+        { "REMOVE", "REMOVE injection id expected" },
+        { "REMOVE x", "Wrong REMOVE argument" },
+        { "SHOW 1", "OK" },
+        { "SHOW", "SHOW injection id expected" },
+        { "INJECT_INTO jiffies BITFLIP 4", "OK" },
+        { "INJECT_INTO 0xffffffff81000000 BITFLIP 1", "OK" },
+        { "INJECT_INTO", "INJECT_INTO symbol or address expected" },
+        { "INJECT_INTO a-b BITFLIP 1", "Wrong INJECT_INTO symbol or argument" },
+        { "INJECT_INTO a INJECT_INTO b BITFLIP 1",
+          "INJECT_INTO symbol or argument already specified" },
+        { "INJECT_INTO a BITFLIP 0", "Wrong BITFLIP argument" },
+        { "INJECT_INTO a BITFLIP", "BITFLIP number of bytes argument expected" },
+        { "INJECT_INTO a INJECT_OFFSET -8 BITFLIP 1", "OK" },
+        { "INJECT_INTO a INJECT_OFFSET x BITFLIP 1",
+          "Wrong INJECT_OFFSET argument" },
+        { "TRIGGER f STACK", "OK" },
+        { "TRIGGER f REGS", "OK" },
+        { "TRIGGER", "TRIGGER symbol or address expected" },
+        { "TRIGGER f TRIGGER g STACK",
+          "TRIGGER symbol or argument already specified" },
+        { "TRIGGER f TRIGGER_OFFSET 4 STACK", "OK" },
+        { "TRIGGER f TRIGGER_OFFSET x STACK", "Wrong TRIGGER_OFFSET argument" },
+        { "TRIGGER f TRIGGER_MODE KPROBE STACK", "OK" },
+        { "TRIGGER f TRIGGER_MODE FTRACE STACK", "OK" },
+        { "TRIGGER f TRIGGER_MODE AUTO STACK", "OK" },
+        { "TRIGGER f TRIGGER_MODE UPROBE STACK", "Wrong TRIGGER_MODE argument" },
+        { "TRIGGER f OUTCOME STACK", "OK" },
+        { "MODULE ext4 DATA RODATA CODE BSS INIT PERCPU", "OK" },
+        { "MODULE ext4 CODE HOT", "OK" },
+        { "MODULE", "MODULE name expected" },
+        { "MODULE a MODULE b DATA", "MODULE name already specified" },
+        { "MODULE ext4 DATA FAULT BITS 3", "OK" },
+        { "MODULE ext4 DATA FAULT BURST 64", "OK" },
+        { "MODULE ext4 DATA FAULT BITS 65", "Wrong FAULT number of bits" },
+        { "MODULE ext4 DATA FAULT XOR 0xff", "OK" },
+        { "MODULE ext4 DATA FAULT STUCK0 0x1", "OK" },
+        { "MODULE ext4 DATA FAULT STUCK1 0x0", "Wrong FAULT mask" },
+        { "MODULE ext4 DATA FAULT RANDOM", "OK" },
+        { "MODULE ext4 DATA FAULT FLIP", "Wrong FAULT argument" },
+        { "TRIGGER f STACK MAX_INJECTIONS 10", "OK" },
+        { "TRIGGER f STACK MAX_INJECTIONS x", "Wrong MAX_INJECTIONS argument" },
+        { "TRIGGER f STACK SKIPPED_INJECTIONS 5", "OK" },
+        { "TRIGGER f STACK SKIPPED_INJECTIONS",
+          "SKIPPED_INJECTIONS number expected" },
+        { "TRIGGER f STACK PROBABILITY 0.001", "OK" },
+        { "TRIGGER f STACK PROBABILITY 1", "OK" },
+        { "TRIGGER f STACK PROBABILITY .5", "Wrong PROBABILITY argument" },
+        { "TRIGGER f STACK EVERY 100", "OK" },
+        { "TRIGGER f STACK EVERY x", "Wrong EVERY argument" },
+        { "TRIGGER f STACK EVERY 0", "Wrong EVERY argument" },
+        { "TRIGGER f STACK POISSON 10", "OK" },
+        { "TRIGGER f STACK EVERY 2 POISSON 3",
+          "PROBABILITY, EVERY, POISSON already specified" },
+        { "TRIGGER_TIMER 1000000 TIMER_JITTER 10 TIMER_PERCPU INJECT_INTO a "
+          "BITFLIP 1", "OK" },
+        { "TRIGGER_TIMER x INJECT_INTO a BITFLIP 1",
+          "Wrong TRIGGER_TIMER argument" },
+        { "MODULE ext4 DATA CAMPAIGN 10 INTERVAL 100 DURATION 1000", "OK" },
+        { "MODULE ext4 DATA CAMPAIGN x", "Wrong CAMPAIGN argument" },
+        { "MODULE ext4 PROFILE 1000", "OK" },
+        { "MODULE ext4 PROFILE x", "Wrong PROFILE argument" },
+        { "INJECT_INTO a BITFLIP 1 DEBUG SEED 42", "OK" },
+        { "INJECT_INTO a BITFLIP 1 SEED x", "Wrong SEED argument" },
+        { "ATOMIC", "OK" },
+        { "TRIGGER f MODULE m REPLAY 0:12:DATA:0x1a0:8:0x10", "OK" },
+        { "TRIGGER f REPLAY 0:1:REGS:0x50:8:0x4", "OK" },
+        { "TRIGGER f REPLAY 0:0:STACK:0x0:2:0x1", "Wrong REPLAY cpu or hit" },
+        { "TRIGGER f REPLAY 0:1:FOO:0x0:2:0x1", "Wrong REPLAY type" },
+        { "TRIGGER f REPLAY 0:1:STACK:0x0:3:0x1",
+          "Wrong REPLAY offset or size" },
+        { "TRIGGER f REPLAY 0:1:STACK:0x0:2:0x10000", "Wrong REPLAY mask" },
+        { "TRIGGER f REPLAY 4294967296:1:STACK:0x0:2:0x1",
+          "Wrong REPLAY cpu or hit" },
+        { "XYZ", "Unexpected keyword" },
+        { "FOO", "FAULT keyword expected" },
+        { "", "OK" },
+        { "TRIGGER f STACK ", "OK" },
+        { "\tTRIGGER f\tSTACK\t", "OK" },
+        { "MODULE m CODE  ", "OK" }
+};
+
+/*
+ * Rules of the validator
+ */
+static const struct ki_test_case ki_validator_cases[] = {
+        { "REMOVE 1 SHOW 2", "REMOVE and SHOW are exclusive" },
+        { "REMOVE 0", "REMOVE, SHOW require positive id" },
+        { "MODULE missing_module DATA", "Module not found" },
+        { "INJECT_INTO missing_symbol BITFLIP 1", "Injection symbol not found" },
+        { "TRIGGER missing_symbol STACK", "Trigger symbol not found" },
+        { "INJECT_INTO a", "INJECT_INTO requires BITFLIP or REPLAY" },
+        { "BITFLIP 1", "BITFLIP requires INJECT_INTO" },
+        { "STACK", "CODE, REGS require TRIGGER" },
+        { "DATA", "RODATA, DATA, CODE, BSS, INIT, PERCPU require MODULE" },
+        { "TRIGGER f FAULT RANDOM",
+          "FAULT requires INJECT_INTO, STACK, REGS or MODULE segment" },
+        { "TRIGGER_OFFSET 4", "TRIGGER_OFFSET require TRIGGER" },
+        { "TRIGGER_MODE KPROBE", "TRIGGER_MODE require TRIGGER" },
+        { "TRIGGER f TRIGGER_OFFSET 4 TRIGGER_MODE FTRACE STACK",
+          "TRIGGER_MODE FTRACE doesn't allow TRIGGER_OFFSET" },
+        { "OUTCOME", "OUTCOME requires TRIGGER" },
+        { "TRIGGER f TRIGGER_OFFSET 4 OUTCOME STACK",
+          "OUTCOME doesn't allow TRIGGER_OFFSET, FTRACE" },
+        { "TRIGGER f TRIGGER_TIMER 1000 STACK",
+          "TRIGGER and TRIGGER_TIMER are exclusive" },
+        { "TIMER_PERCPU", "TIMER_JITTER, TIMER_PERCPU require TRIGGER_TIMER" },
+        { "TRIGGER_TIMER 1000",
+          "TRIGGER_TIMER requires INJECT_INTO, MODULE segment or REPLAY" },
+        { "TRIGGER_TIMER 1 TIMER_PERCPU INJECT_INTO x BITFLIP 1 DEBUG",
+          "TRIGGER_TIMER must be at least 10000ns" },
+        { "TRIGGER_TIMER 9999 INJECT_INTO x BITFLIP 1",
+          "TRIGGER_TIMER must be at least 10000ns" },
+        { "TRIGGER_TIMER 10000 INJECT_INTO x BITFLIP 1", "OK" },
+        { "TRIGGER_TIMER 10000 TIMER_JITTER 10000 INJECT_INTO x BITFLIP 1",
+          "OK" },
+        { "TRIGGER_TIMER 10000 TIMER_JITTER 10001 INJECT_INTO x BITFLIP 1",
+          "TIMER_JITTER can't exceed TRIGGER_TIMER" },
+        { "INJECT_INTO a BITFLIP 1 MAX_INJECTIONS 1",
+          "MAX_INJECTIONS require TRIGGER" },
+        { "TRIGGER f STACK MAX_INJECTIONS -1", "MAX_INJECTIONS must be >= 0" },
+        { "INJECT_INTO a BITFLIP 1 SKIPPED_INJECTIONS 1",
+          "SKIPPED_INJECTIONS require TRIGGER" },
+        { "INJECT_INTO a BITFLIP 1 EVERY 2",
+          "PROBABILITY, EVERY, POISSON require TRIGGER" },
+        { "TRIGGER f STACK CAMPAIGN 1", "CAMPAIGN doesn't allow TRIGGER" },
+        { "CAMPAIGN 1", "CAMPAIGN requires INJECT_INTO or MODULE segment" },
+        { "INJECT_INTO a BITFLIP 1 INTERVAL 5",
+          "INTERVAL, DURATION require CAMPAIGN" },
+        { "PROFILE 10", "PROFILE requires MODULE" },
+        { "MODULE m DATA PROFILE 10",
+          "PROFILE doesn't allow injection keywords" },
+        { "TRIGGER f STACK PROBABILITY 1.5",
+          "PROBABILITY must be in (0, 1] range" },
+        { "TRIGGER f STACK EVERY 2147483648",
+          "EVERY, POISSON must be in [1, 2^31) range" },
+        { "MODULE m REPLAY 0:1:DATA:0x0:8:0x1",
+          "REPLAY requires TRIGGER or TRIGGER_TIMER" },
+        { "TRIGGER f STACK REPLAY 0:1:STACK:0x0:8:0x1",
+          "REPLAY doesn't allow FAULT, STACK, REGS, segments, "
+          "limits or scheduling" },
+        { "TRIGGER f REPLAY 0:1:TARGET:0x0:8:0x1",
+          "REPLAY TARGET requires INJECT_INTO" },
+        { "TRIGGER_TIMER 100000 REPLAY 0:1:REGS:0x8:8:0x1",
+          "REPLAY STACK, REGS require TRIGGER" },
+        { "TRIGGER f REPLAY 0:1:DATA:0x0:8:0x1",
+          "REPLAY segments require MODULE" },
+        { "TRIGGER f INJECT_INTO a BITFLIP 16 REPLAY 0:1:TARGET:0x8:8:0x1",
+          "OK" },
+        { "TRIGGER f INJECT_INTO a BITFLIP 16 REPLAY 0:1:TARGET:0x9:8:0x1",
+          "REPLAY TARGET offset out of BITFLIP bytes" },
+        { "TRIGGER f INJECT_INTO a REPLAY 0:1:TARGET:0x0:1:0x1",
+          "REPLAY TARGET offset out of BITFLIP bytes" },
+        { "TRIGGER f INJECT_INTO a BITFLIP 16 "
+          "REPLAY 0:1:TARGET:0xfffffffffffffff8:8:0x1",
+          "REPLAY TARGET offset out of BITFLIP bytes" },
+        { "TRIGGER f REPLAY 0:1:STACK:0x2:8:0x1", "OK" },
+        { "TRIGGER f REPLAY 0:1:STACK:0x3:8:0x1",
+          "REPLAY STACK offset out of stack bytes" },
+        { "TRIGGER f REPLAY 0:1:STACK:0xfffffffffffffff8:8:0x1",
+          "REPLAY STACK offset out of stack bytes" }
+};
+
+/*
+ * Commands of the large batch, all valid
+ */
+static const char *ki_large_batch_commands[] = {
+        "TRIGGER do_fork INJECT_INTO jiffies BITFLIP 1 MAX_INJECTIONS 10",
+        "TRIGGER vfs_read TRIGGER_MODE FTRACE STACK PROBABILITY 0.001",
+        "MODULE ext4 DATA RODATA BSS FAULT BITS 3 SEED 42",
+        "TRIGGER_TIMER 1000000 TIMER_JITTER 1000 MODULE ext4 CODE HOT",
+        "TRIGGER vfs_read OUTCOME REGS EVERY 100 SKIPPED_INJECTIONS 5 DEBUG",
+        "TRIGGER vfs_read MODULE ext4 REPLAY 0:12:DATA:0x1a0:8:0x10 ATOMIC",
+        "REMOVE 3"
+};
+
+/* --- HELPERS ------------------------------------------------------------- */
+/*
+ * Parse and validate one command. Command is copied to a buffer of its
+ * size with a new line terminator, as a line of a batch.
+ * Returns true on success, result is passed to msg.
+ */
+static bool ki_test_command(const char *command, struct ki_injection *injection,
+                            char **msg)
+{
+        size_t len = strlen(command), pos;
+        char *buffer = malloc(len + 1);
+        bool ok;
+
+        if (!buffer) abort();
+        memcpy(buffer, command, len);
+        buffer[len] = '\n';
+
+        ki_init_injection(injection);
+        ok = ki_parse(buffer, len, &pos, injection, msg) &&
+             ki_validate_injection(injection, msg);
+        free(buffer);
+        return ok;
+}
+
+/*
+ * Check results of a table of commands
+ */
+static void ki_test_cases(const struct ki_test_case *cases, size_t count)
+{
+        struct ki_injection injection;
+        size_t i;
+        char *msg;
+
+        for (i = 0; i < count; ++i) {
+                ki_test_command(cases[i].command, &injection, &msg);
+                KI_CHECK(!strcmp(msg, cases[i].msg), "'%s': '%s', expected '%s'",
+                         cases[i].command, msg, cases[i].msg);
+                ki_stubs_free(&injection);
+        }
+}
+
+/*
+ * Arm triggered injection like ki_execute_injection does
+ */
+static void ki_test_arm(const char *command, struct ki_injection *injection)
+{
+        char *msg;
+
+        if (!ki_test_command(command, injection, &msg)) {
+                fprintf(stderr, "'%s': %s\n", command, msg);
+                abort();
+        }
+
+        injection->pcpu = calloc(KI_SHIM_CPUS, sizeof(*injection->pcpu));
+        if (!injection->pcpu) abort();
+        atomic64_set(&injection->budget, injection->max_inj);
+        atomic64_set(&injection->skipped, injection->skipped_inj);
+        ki_seed_injection(injection);
+}
+
+static void ki_test_disarm(struct ki_injection *injection)
+{
+        free(injection->pcpu);
+        ki_stubs_free(injection);
+}
+
+/*
+ * Hit trigger on a CPU.
+ * Returns true if injection is executed.
+ */
+static bool ki_test_hit(struct ki_injection *injection, int cpu)
+{
+        struct ki_pcpu *pcpu;
+
+        ki_shim_cpu = cpu;
+        pcpu = this_cpu_ptr(injection->pcpu);
+        pcpu->hits++;
+        return ki_trigger_claim(injection, pcpu);
+}
+
+/*
+ * Hit trigger count times on a CPU and store executed hits as a bit mask
+ * Returns number of executed hits.
+ */
+static unsigned int ki_test_hits(struct ki_injection *injection, int cpu,
+                                 unsigned int count, u64 *fired)
+{
+        unsigned int i, done = 0;
+
+        if (fired) *fired = 0;
+        for (i = 0; i < count; ++i) {
+                if (!ki_test_hit(injection, cpu)) continue;
+                if (fired && i < 64) *fired |= 1ULL << i;
+                ++done;
+        }
+        return done;
+}
+
+/* --- BATCH TESTS --------------------------------------------------------- */
+/*
+ * Lines of one buffer are parsed separately, blanks at the end of a line
+ * don't reach the next one
+ */
+static void ki_test_batch(void)
+{
+        char batch[] = "TRIGGER f1 STACK \nTRIGGER f2 REGS\n"
+                       "MODULE m CODE \t\nMODULE n DATA";
+        static const enum ki_flags_e flags[] = {
+                KI_FLG_STACK, KI_FLG_REGS, KI_FLG_CODE, KI_FLG_DATA
+        };
+        struct ki_injection injection;
+        size_t start = 0, end, pos, len = strlen(batch);
+        unsigned int line = 0;
+        char *msg;
+
+        while (start < len) {
+                for (end = start; end < len && batch[end] != '\n'; ++end);
+
+                ki_init_injection(&injection);
+                KI_CHECK(ki_parse(batch + start, end - start, &pos,
+                                  &injection, &msg) &&
+                         ki_validate_injection(&injection, &msg),
+                         "batch line %u: %zu: %s", line + 1, pos, msg);
+                KI_CHECK(pos <= end - start && injection.flags == flags[line],
+                         "batch line %u: position %zu flags %d", line + 1,
+                         pos, injection.flags);
+                ki_stubs_free(&injection);
+
+                start = end + 1;
+                ++line;
+        }
+        KI_CHECK(line == 4, "batch has %u lines", line);
+}
+
+/* --- SELECTION TESTS ----------------------------------------------------- */
+static void ki_test_every(void)
+{
+        struct ki_injection injection;
+        u64 fired;
+
+        ki_test_arm("TRIGGER f STACK EVERY 3 SEED 7", &injection);
+        KI_CHECK(ki_test_hits(&injection, 0, 9, &fired) == 3 &&
+                 fired == 0x124, "EVERY 3 fired 0x%llx",
+                 (unsigned long long)fired);
+
+        /* Every CPU counts its own hits */
+        KI_CHECK(ki_test_hits(&injection, 1, 2, NULL) == 0,
+                 "EVERY 3 fired on second hit of another CPU");
+        KI_CHECK(ki_test_hits(&injection, 1, 1, NULL) == 1,
+                 "EVERY 3 didn't fire on third hit of another CPU");
+        ki_test_disarm(&injection);
+}
+
+static void ki_test_skipped(void)
+{
+        struct ki_injection injection;
+        u64 fired;
+
+        ki_test_arm("TRIGGER f STACK SKIPPED_INJECTIONS 5 SEED 7", &injection);
+        KI_CHECK(ki_test_hits(&injection, 0, 8, &fired) == 3 &&
+                 fired == 0xe0, "SKIPPED_INJECTIONS 5 fired 0x%llx",
+                 (unsigned long long)fired);
+        ki_test_disarm(&injection);
+
+        /* Skipped hits are shared by CPUs and counted before schedule */
+        ki_test_arm("TRIGGER f STACK SKIPPED_INJECTIONS 2 EVERY 2 SEED 7",
+                    &injection);
+        KI_CHECK(ki_test_hits(&injection, 0, 1, NULL) == 0 &&
+                 ki_test_hits(&injection, 1, 1, NULL) == 0 &&
+                 ki_test_hits(&injection, 0, 4, &fired) == 2 && fired == 0xa,
+                 "SKIPPED_INJECTIONS 2 EVERY 2 fired 0x%llx",
+                 (unsigned long long)fired);
+        ki_test_disarm(&injection);
+}
+
+static void ki_test_max(void)
+{
+        struct ki_injection injection;
+        unsigned int done = 0;
+        int cpu;
+
+        ki_test_arm("TRIGGER f STACK MAX_INJECTIONS 5 SEED 7", &injection);
+        for (cpu = 0; cpu < KI_SHIM_CPUS; ++cpu)
+                done += ki_test_hits(&injection, cpu, 3, NULL);
+        KI_CHECK(done == 5, "MAX_INJECTIONS 5 executed %u", done);
+        KI_CHECK(atomic64_read(&injection.budget) == 0,
+                 "MAX_INJECTIONS 5 left budget %lld",
+                 atomic64_read(&injection.budget));
+        ki_test_disarm(&injection);
+
+        /* Hits not selected by schedule don't spend budget */
+        ki_test_arm("TRIGGER f STACK MAX_INJECTIONS 2 EVERY 4 SEED 7",
+                    &injection);
+        done = ki_test_hits(&injection, 0, 20, NULL);
+        KI_CHECK(done == 2, "MAX_INJECTIONS 2 EVERY 4 executed %u", done);
+        ki_test_disarm(&injection);
+}
+
+static void ki_test_probability(void)
+{
+        struct ki_injection first, second;
+        unsigned int done, i;
+        u64 fired0, fired1, again;
+        bool same = true;
+
+        /* Fixed seed gives the same selection */
+        ki_test_arm("TRIGGER f STACK PROBABILITY 0.25 SEED 42", &first);
+        ki_test_arm("TRIGGER f STACK PROBABILITY 0.25 SEED 42", &second);
+        for (i = 0; i < 1000; ++i)
+                if (ki_test_hit(&first, 0) != ki_test_hit(&second, 0))
+                        same = false;
+        KI_CHECK(same, "PROBABILITY with SEED is not repeatable");
+
+        /* CPUs get different streams */
+        ki_test_hits(&first, 1, 64, &fired0);
+        ki_test_hits(&first, 2, 64, &fired1);
+        KI_CHECK(fired0 != fired1, "PROBABILITY streams of CPUs are equal");
+        ki_test_hits(&second, 1, 64, &again);
+        KI_CHECK(fired0 == again, "PROBABILITY stream of CPU 1 differs");
+        ki_test_disarm(&first);
+        ki_test_disarm(&second);
+
+        /* Rate is close to probability, 5 sigma bounds */
+        ki_test_arm("TRIGGER f STACK PROBABILITY 0.25 SEED 42", &first);
+        done = ki_test_hits(&first, 0, 100000, NULL);
+        KI_CHECK(done > 25000 - 685 && done < 25000 + 685,
+                 "PROBABILITY 0.25 executed %u of 100000", done);
+        ki_test_disarm(&first);
+
+        ki_test_arm("TRIGGER f STACK PROBABILITY 1 SEED 42", &first);
+        done = ki_test_hits(&first, 0, 1000, NULL);
+        KI_CHECK(done == 1000, "PROBABILITY 1 executed %u of 1000", done);
+        ki_test_disarm(&first);
+}
+
+static void ki_test_poisson(void)
+{
+        struct ki_injection injection;
+        unsigned int done;
+
+        /* Mean gap of 10 hits, 5 sigma bounds */
+        ki_test_arm("TRIGGER f STACK POISSON 10 SEED 42", &injection);
+        done = ki_test_hits(&injection, 0, 100000, NULL);
+        KI_CHECK(done > 10000 - 500 && done < 10000 + 500,
+                 "POISSON 10 executed %u of 100000", done);
+        ki_test_disarm(&injection);
+}
+
+/* --- TIMING TESTS ------------------------------------------------------- */
+/*
+ * Large batch is parsed and validated line by line like a write of
+ * /proc/kernelinjector. Floor is generous, it catches only a parser which
+ * became orders of magnitude slower, e.g. quadratic in batch size.
+ */
+static void ki_test_large_batch(void)
+{
+        size_t templates = sizeof(ki_large_batch_commands) /
+                           sizeof(ki_large_batch_commands[0]);
+        size_t i, size = 0, len = 0, start, end, pos, failed = 0;
+        struct ki_injection injection;
+        struct timespec begin, finish;
+        double elapsed, rate;
+        char *batch, *msg;
+
+        for (i = 0; i < KI_TEST_BATCH; ++i)
+                size += strlen(ki_large_batch_commands[i % templates]) + 1;
+        batch = malloc(size);
+        if (!batch) abort();
+        for (i = 0; i < KI_TEST_BATCH; ++i) {
+                const char *command = ki_large_batch_commands[i % templates];
+
+                memcpy(batch + len, command, strlen(command));
+                len += strlen(command);
+                batch[len++] = '\n';
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        for (start = 0; start < len; start = end + 1) {
+                for (end = start; batch[end] != '\n'; ++end);
+
+                ki_init_injection(&injection);
+                if (!ki_parse(batch + start, end - start, &pos, &injection,
+                              &msg) ||
+                    !ki_validate_injection(&injection, &msg))
+                        ++failed;
+                ki_stubs_free(&injection);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &finish);
+        free(batch);
+
+        elapsed = (finish.tv_sec - begin.tv_sec) +
+                  (finish.tv_nsec - begin.tv_nsec) / 1e9;
+        rate = elapsed > 0 ? KI_TEST_BATCH / elapsed : KI_TEST_MIN_RATE;
+        KI_CHECK(!failed, "large batch: %zu commands failed", failed);
+        KI_CHECK(rate >= KI_TEST_MIN_RATE,
+                 "large batch: %.0f commands/s, expected at least %d", rate,
+                 KI_TEST_MIN_RATE);
+}
+
+int main(void)
+{
+        ki_test_cases(ki_keyword_cases,
+                      sizeof(ki_keyword_cases) / sizeof(ki_keyword_cases[0]));
+        ki_test_cases(ki_validator_cases,
+                      sizeof(ki_validator_cases) / 
+                      sizeof(ki_validator_cases[0]));
+        ki_test_batch();
+        ki_test_every();
+        ki_test_skipped();
+        ki_test_max();
+        ki_test_probability();
+        ki_test_poisson();
+        ki_test_large_batch();
+
+        printf("%u checks, %u failed\n", ki_checks, ki_failures);
+        return ki_failures ? 1 : 0;
+}
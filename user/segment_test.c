@@ -0,0 +1,333 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+/*
+ * Tests of segment tables which select injected memory of MODULE commands.
+ * segment.c is built in user space over a fake vmlinux symbol table and
+ * fake modules with the layout of 3.x kernels. Every failed check is
+ * reported with its line and the test exits with non-zero status.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "segment.h"
+#include "profile.h"
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_CHECK(cond, ...) \
+        do { \
+                ++ki_checks; \
+                if (!(cond)) { \
+                        ++ki_failures; \
+                        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+                        fprintf(stderr, __VA_ARGS__); \
+                        fprintf(stderr, "\n"); \
+                } \
+        } while (0)
+
+#define KI_TEST_CORE   0xffffffffa0000000UL
+#define KI_TEST_INIT   0xffffffffa0100000UL
+#define KI_TEST_PERCPU 0xffffffff82000000UL
+
+/* --- STRUCTURES ---------------------------------------------------------- */
+/*
+ * Segment expected in a map
+ */
+struct ki_test_segment
+{
+        enum ki_seg_e  seg;
+        unsigned long  start;
+        unsigned long  size;
+};
+
+/*
+ * Address of a vmlinux symbol
+ */
+struct ki_test_symbol
+{
+        const char    *name;
+        unsigned long  addr;
+};
+
+/* --- GLOBALS ------------------------------------------------------------- */
+static unsigned int ki_checks;
+static unsigned int ki_failures;
+
+/* Init sections of vmlinux are not tracked, bss symbols are missing */
+static const struct ki_test_symbol ki_test_vmlinux[] = {
+        { "_stext",          0xffffffff81000000UL },
+        { "_etext",          0xffffffff81600000UL },
+        { "__start_rodata",  0xffffffff81800000UL },
+        { "__end_rodata",    0xffffffff81a00000UL },
+        { "_sdata",          0xffffffff81c00000UL },
+        { "_edata",          0xffffffff81d00000UL },
+        { "__per_cpu_start", 0 },
+        { "__per_cpu_end",   0x1a000 }
+};
+
+/* Text, rodata, data and bss of the writable part with a text symbol,
+ * which doesn't move bss */
+static Elf_Sym ki_test_symtab[] = {
+        { .st_info = 't', .st_value = KI_TEST_CORE + 0x100, .st_size = 0x40 },
+        { .st_info = 'd', .st_value = KI_TEST_CORE + 0x1a00, .st_size = 8 },
+        { .st_info = 'B', .st_value = KI_TEST_CORE + 0x2400, .st_size = 0x100 },
+        { .st_info = 'b', .st_value = KI_TEST_CORE + 0x2000, .st_size = 0x10 },
+        { .st_info = 'b', .st_value = KI_TEST_CORE + 0x3000, .st_size = 0x10 }
+};
+
+static struct module ki_test_module = {
+        .state          = MODULE_STATE_COMING,
+        .name           = "fake",
+        .module_init    = (void *)KI_TEST_INIT,
+        .module_core    = (void *)KI_TEST_CORE,
+        .init_size      = 0x800,
+        .core_size      = 0x2800,
+        .core_text_size = 0x1000,
+        .core_ro_size   = 0x1800,
+        .percpu         = (void *)KI_TEST_PERCPU,
+        .percpu_size    = 0x40,
+        .symtab         = ki_test_symtab,
+        .num_symtab     = sizeof(ki_test_symtab) / sizeof(ki_test_symtab[0])
+};
+
+static struct notifier_block *ki_test_nb;
+static bool ki_test_loaded = true;
+static unsigned int ki_test_profiles;
+
+struct mutex module_mutex;
+
+/* --- KERNEL STUBS -------------------------------------------------------- */
+unsigned long kallsyms_lookup_name(const char *name)
+{
+        size_t i;
+
+        for (i = 0; i < sizeof(ki_test_vmlinux) / sizeof(ki_test_vmlinux[0]);
+             ++i)
+                if (!strcmp(ki_test_vmlinux[i].name, name))
+                        return ki_test_vmlinux[i].addr;
+        return 0;
+}
+
+struct module *find_module(const char *name)
+{
+        if (ki_test_loaded && !strcmp(name, ki_test_module.name))
+                return &ki_test_module;
+        return NULL;
+}
+
+int register_module_notifier(struct notifier_block *nb)
+{
+        ki_test_nb = nb;
+        return 0;
+}
+
+int unregister_module_notifier(struct notifier_block *nb)
+{
+        if (ki_test_nb == nb) ki_test_nb = NULL;
+        return 0;
+}
+
+void ki_profile_free(struct ki_profile *profile)
+{
+        ++ki_test_profiles;
+        free(profile);
+}
+
+/* --- HELPERS ------------------------------------------------------------- */
+/*
+ * Check segments of a map, segments which are not listed must be empty
+ */
+static void ki_test_map(const char *name, const struct ki_seg_map *map,
+                        const struct ki_test_segment *expected, size_t count)
+{
+        struct ki_segment want[KI_SEG_MAX];
+        int seg;
+        size_t i;
+
+        KI_CHECK(map, "%s has no map", name);
+        if (!map) return;
+
+        memset(want, 0, sizeof(want));
+        for (i = 0; i < count; ++i) {
+                want[expected[i].seg].start = expected[i].start;
+                want[expected[i].seg].size = expected[i].size;
+        }
+
+        for (seg = 0; seg < KI_SEG_MAX; ++seg)
+                KI_CHECK(map->seg[seg].start == want[seg].start &&
+                         map->seg[seg].size == want[seg].size,
+                         "%s segment %d: 0x%lx+0x%lx, expected 0x%lx+0x%lx",
+                         name, seg, map->seg[seg].start, map->seg[seg].size,
+                         want[seg].start, want[seg].size);
+}
+
+/*
+ * Pass module state change to the segment table
+ */
+static void ki_test_notify(enum module_state state)
+{
+        ki_test_module.state = state;
+        ki_test_nb->notifier_call(ki_test_nb, state, &ki_test_module);
+}
+
+/* --- SEGMENT TESTS ------------------------------------------------------- */
+/*
+ * vmlinux segments come from pairs of its symbols, missing pair leaves
+ * segment empty
+ */
+static void ki_test_vmlinux_map(void)
+{
+        static const struct ki_test_segment expected[] = {
+                { KI_SEG_TEXT,   0xffffffff81000000UL, 0x600000 },
+                { KI_SEG_RODATA, 0xffffffff81800000UL, 0x200000 },
+                { KI_SEG_DATA,   0xffffffff81c00000UL, 0x100000 },
+                { KI_SEG_PERCPU, 0,                    0x1a000 }
+        };
+        struct ki_segments *entry = ki_segments_get(KI_VMLINUX);
+
+        KI_CHECK(entry, "vmlinux has no segment table entry");
+        if (!entry) return;
+        KI_CHECK(!entry->map->module, "vmlinux map has a module");
+        ki_test_map(KI_VMLINUX, entry->map, expected,
+                    sizeof(expected) / sizeof(expected[0]));
+}
+
+/*
+ * Module is split by its layout, bss spans its symbols in the writable
+ * part and init sections are kept only while module is coming
+ */
+static void ki_test_module_map(void)
+{
+        static const struct ki_test_segment coming[] = {
+                { KI_SEG_TEXT,   KI_TEST_CORE,          0x1000 },
+                { KI_SEG_RODATA, KI_TEST_CORE + 0x1000, 0x800 },
+                { KI_SEG_DATA,   KI_TEST_CORE + 0x1800, 0x800 },
+                { KI_SEG_BSS,    KI_TEST_CORE + 0x2000, 0x500 },
+                { KI_SEG_INIT,   KI_TEST_INIT,          0x800 },
+                { KI_SEG_PERCPU, KI_TEST_PERCPU,        0x40 }
+        };
+        static const struct ki_test_segment live[] = {
+                { KI_SEG_TEXT,   KI_TEST_CORE,          0x1000 },
+                { KI_SEG_RODATA, KI_TEST_CORE + 0x1000, 0x800 },
+                { KI_SEG_DATA,   KI_TEST_CORE + 0x1800, 0x800 },
+                { KI_SEG_BSS,    KI_TEST_CORE + 0x2000, 0x500 },
+                { KI_SEG_PERCPU, KI_TEST_PERCPU,        0x40 }
+        };
+        struct ki_segments *entry = ki_segments_get("fake");
+
+        KI_CHECK(entry, "fake module has no segment table entry");
+        if (!entry) return;
+        KI_CHECK(entry->map->module == &ki_test_module,
+                 "fake module map has wrong module");
+        ki_test_map("coming", entry->map, coming,
+                    sizeof(coming) / sizeof(coming[0]));
+        KI_CHECK(ki_segments_get("fake") == entry,
+                 "fake module has two segment table entries");
+
+        ki_test_notify(MODULE_STATE_LIVE);
+        ki_test_map("live", entry->map, live, sizeof(live) / sizeof(live[0]));
+}
+
+/*
+ * Writable part without bss symbols is data only
+ */
+static void ki_test_module_no_bss(void)
+{
+        static const struct ki_test_segment live[] = {
+                { KI_SEG_TEXT,   KI_TEST_CORE,          0x1000 },
+                { KI_SEG_RODATA, KI_TEST_CORE + 0x1000, 0x800 },
+                { KI_SEG_DATA,   KI_TEST_CORE + 0x1800, 0x1000 },
+                { KI_SEG_PERCPU, KI_TEST_PERCPU,        0x40 }
+        };
+        struct ki_segments *entry = ki_segments_get("fake");
+
+        ki_test_module.num_symtab = 2;
+        ki_test_notify(MODULE_STATE_LIVE);
+        ki_test_map("no bss", entry->map, live,
+                    sizeof(live) / sizeof(live[0]));
+        ki_test_module.num_symtab = sizeof(ki_test_symtab) /
+                                    sizeof(ki_test_symtab[0]);
+}
+
+/*
+ * Entry stays when module goes, its map and profile are dropped and a
+ * reloaded module gets a new map
+ */
+static void ki_test_module_reload(void)
+{
+        struct ki_segments *entry = ki_segments_get("fake");
+        struct ki_profile *profile = calloc(1, sizeof(*profile));
+        struct ki_profile *stale = calloc(1, sizeof(*stale));
+
+        if (!profile || !stale) abort();
+        profile->start = KI_TEST_CORE;
+        stale->start = KI_TEST_CORE + 0x1000;
+        KI_CHECK(ki_segments_set_profile(entry, profile),
+                 "profile of module text rejected");
+        KI_CHECK(!ki_segments_set_profile(entry, stale),
+                 "profile of other text accepted");
+        free(stale);
+
+        ki_test_notify(MODULE_STATE_GOING);
+        ki_test_loaded = false;
+        KI_CHECK(!entry->map && !entry->profile && ki_test_profiles == 1,
+                 "going module keeps map %p profile %p", (void *)entry->map,
+                 (void *)entry->profile);
+        KI_CHECK(!ki_segments_get("fake"), "unloaded module has an entry");
+
+        ki_test_loaded = true;
+        ki_test_module.module_core = (void *)(KI_TEST_CORE + 0x10000);
+        ki_test_notify(MODULE_STATE_COMING);
+        KI_CHECK(entry->map && entry->map->seg[KI_SEG_TEXT].start ==
+                 KI_TEST_CORE + 0x10000, "reloaded module keeps old map");
+        ki_test_module.module_core = (void *)KI_TEST_CORE;
+}
+
+/*
+ * Modules which are not loaded, are going or have too long names have no
+ * entry
+ */
+static void ki_test_module_missing(void)
+{
+        char name[MODULE_NAME_LEN + 1];
+
+        KI_CHECK(!ki_segments_get("absent"), "absent module has an entry");
+
+        memset(name, 'f', sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
+        KI_CHECK(!ki_segments_get(name), "too long module name has an entry");
+}
+
+int main(void)
+{
+        KI_CHECK(ki_segments_init() == 0 && ki_test_nb,
+                 "segment table not initialized");
+        if (!ki_test_nb) return 1;
+
+        ki_test_vmlinux_map();
+        ki_test_module_missing();
+        ki_test_module_map();
+        ki_test_module_no_bss();
+        ki_test_module_reload();
+
+        ki_segments_exit();
+        KI_CHECK(!ki_test_nb, "module notifier not unregistered");
+
+        printf("%u checks, %u failed\n", ki_checks, ki_failures);
+        return ki_failures ? 1 : 0;
+}
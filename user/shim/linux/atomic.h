@@ -0,0 +1,49 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_SHIM_ATOMIC_H
+#define KI_SHIM_ATOMIC_H
+
+#include <linux/types.h>
+
+static inline long long atomic64_read(const atomic64_t *v)
+{
+        return __atomic_load_n(&v->counter, __ATOMIC_RELAXED);
+}
+
+static inline void atomic64_set(atomic64_t *v, long long i)
+{
+        __atomic_store_n(&v->counter, i, __ATOMIC_RELAXED);
+}
+
+/*
+ * Same contract as kernel atomic64_dec_if_positive: counter is decremented
+ * only if result is not negative, result is returned in any case
+ */
+static inline long long atomic64_dec_if_positive(atomic64_t *v)
+{
+        long long old = atomic64_read(v);
+
+        while (old > 0 &&
+               !__atomic_compare_exchange_n(&v->counter, &old, old - 1, 0,
+                                            __ATOMIC_SEQ_CST,
+                                            __ATOMIC_RELAXED));
+        return old - 1;
+}
+
+#endif /*KI_SHIM_ATOMIC_H*/
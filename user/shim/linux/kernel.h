@@ -0,0 +1,67 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_SHIM_KERNEL_H
+#define KI_SHIM_KERNEL_H
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/types.h>
+
+#define KERN_ERR   ""
+#define KERN_DEBUG ""
+#define KERN_CONT  ""
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* Diagnostics are not part of measured parsing cost */
+#define printk(...) ((void)0)
+
+/*
+ * Same contract as kernel kstrtol: whole string must be a number
+ */
+static inline int kstrtol(const char *s, unsigned int base, long *res)
+{
+        char *end;
+        long value;
+
+        errno = 0;
+        value = strtol(s, &end, base);
+        if (end == s || *end) return -EINVAL;
+        if (errno) return -ERANGE;
+        *res = value;
+        return 0;
+}
+
+static inline int kstrtoul(const char *s, unsigned int base,
+                           unsigned long *res)
+{
+        char *end;
+        unsigned long value;
+
+        if (*s == '-') return -EINVAL;
+        errno = 0;
+        value = strtoul(s, &end, base);
+        if (end == s || *end) return -EINVAL;
+        if (errno) return -ERANGE;
+        *res = value;
+        return 0;
+}
+
+#endif /*KI_SHIM_KERNEL_H*/
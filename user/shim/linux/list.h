@@ -0,0 +1,55 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_SHIM_LIST_H
+#define KI_SHIM_LIST_H
+
+#include <stddef.h>
+#include <linux/types.h>
+
+#define LIST_HEAD(name) struct list_head name = { &(name), &(name) }
+
+#define list_entry(ptr, type, member) \
+        ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define list_for_each_entry(pos, head, member) \
+        for (pos = list_entry((head)->next, __typeof__(*pos), member); \
+             &pos->member != (head); \
+             pos = list_entry(pos->member.next, __typeof__(*pos), member))
+
+#define list_for_each_entry_safe(pos, n, head, member) \
+        for (pos = list_entry((head)->next, __typeof__(*pos), member), \
+             n = list_entry(pos->member.next, __typeof__(*pos), member); \
+             &pos->member != (head); \
+             pos = n, n = list_entry(n->member.next, __typeof__(*n), member))
+
+static inline void list_add(struct list_head *entry, struct list_head *head)
+{
+        entry->next = head->next;
+        entry->prev = head;
+        head->next->prev = entry;
+        head->next = entry;
+}
+
+static inline void list_del(struct list_head *entry)
+{
+        entry->prev->next = entry->next;
+        entry->next->prev = entry->prev;
+}
+
+#endif /*KI_SHIM_LIST_H*/
@@ -0,0 +1,73 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_SHIM_MODULE_H
+#define KI_SHIM_MODULE_H
+
+#include <elf.h>
+#include <errno.h>
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+
+#define MODULE_NAME_LEN (64 - sizeof(unsigned long))
+
+#define NOTIFY_OK 0x0001
+
+typedef Elf64_Sym Elf_Sym;
+
+enum module_state
+{
+        MODULE_STATE_LIVE,
+        MODULE_STATE_COMING,
+        MODULE_STATE_GOING,
+        MODULE_STATE_UNFORMED
+};
+
+/*
+ * Layout of a loaded module as of 3.x kernels, symbol table keeps kallsyms
+ * type in st_info
+ */
+struct module
+{
+        enum module_state  state;
+        char               name[MODULE_NAME_LEN];
+        void              *module_init;
+        void              *module_core;
+        unsigned int       init_size, core_size;
+        unsigned int       init_text_size, core_text_size;
+        unsigned int       init_ro_size, core_ro_size;
+        void __percpu     *percpu;
+        unsigned int       percpu_size;
+        Elf_Sym           *symtab;
+        unsigned int       num_symtab;
+};
+
+struct notifier_block
+{
+        int (*notifier_call)(struct notifier_block *nb, unsigned long action,
+                             void *data);
+};
+
+/* Provided by the test which builds module code */
+extern struct mutex module_mutex;
+struct module *find_module(const char *name);
+int register_module_notifier(struct notifier_block *nb);
+int unregister_module_notifier(struct notifier_block *nb);
+
+#endif /*KI_SHIM_MODULE_H*/
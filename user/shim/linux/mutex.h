@@ -0,0 +1,30 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_SHIM_MUTEX_H
+#define KI_SHIM_MUTEX_H
+
+/* Lock state is kept only for lockdep_is_held */
+struct mutex { int locked; };
+
+#define DEFINE_MUTEX(name) struct mutex name = { 0 }
+#define mutex_lock(m)       ((m)->locked++)
+#define mutex_unlock(m)     ((m)->locked--)
+#define lockdep_is_held(m)  ((m)->locked)
+
+#endif /*KI_SHIM_MUTEX_H*/
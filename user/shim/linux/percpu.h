@@ -0,0 +1,38 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_SHIM_PERCPU_H
+#define KI_SHIM_PERCPU_H
+
+#include <linux/types.h>
+
+/*
+ * Per CPU data is an array of KI_SHIM_CPUS elements, every thread selects
+ * its CPU with ki_shim_cpu
+ */
+#define KI_SHIM_CPUS 4
+
+extern __thread int ki_shim_cpu;
+
+#define for_each_possible_cpu(cpu) \
+        for ((cpu) = 0; (cpu) < KI_SHIM_CPUS; ++(cpu))
+#define per_cpu_ptr(ptr, cpu) (&(ptr)[cpu])
+#define this_cpu_ptr(ptr)     (&(ptr)[ki_shim_cpu])
+#define smp_processor_id()    ki_shim_cpu
+
+#endif /*KI_SHIM_PERCPU_H*/
@@ -0,0 +1,32 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_SHIM_RANDOM_H
+#define KI_SHIM_RANDOM_H
+
+#include <stdlib.h>
+#include <linux/types.h>
+
+static inline void get_random_bytes(void *buf, int nbytes)
+{
+        unsigned char *p = buf;
+
+        while (nbytes-- > 0) *p++ = (unsigned char)random();
+}
+
+#endif /*KI_SHIM_RANDOM_H*/
@@ -0,0 +1,31 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_SHIM_RCUPDATE_H
+#define KI_SHIM_RCUPDATE_H
+
+#include <linux/types.h>
+
+/* Single threaded tests, RCU pointers are plain pointers */
+#define rcu_access_pointer(p)             (p)
+#define rcu_dereference_protected(p, c)   (p)
+#define rcu_assign_pointer(p, v)          ((p) = (v))
+#define RCU_INIT_POINTER(p, v)            ((p) = (v))
+#define synchronize_sched()               ((void)0)
+
+#endif /*KI_SHIM_RCUPDATE_H*/
@@ -0,0 +1,39 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_SHIM_STRING_H
+#define KI_SHIM_STRING_H
+
+#include <string.h>
+
+#define strlcpy ki_shim_strlcpy
+
+static inline size_t ki_shim_strlcpy(char *dst, const char *src, size_t size)
+{
+        size_t len = strlen(src);
+
+        if (size) {
+                size_t n = len < size - 1 ? len : size - 1;
+
+                memcpy(dst, src, n);
+                dst[n] = '\0';
+        }
+        return len;
+}
+
+#endif /*KI_SHIM_STRING_H*/
@@ -0,0 +1,53 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+/*
+ * Minimal kernel API used by parser.c and validate.c in a userspace build
+ */
+#ifndef KI_SHIM_TYPES_H
+#define KI_SHIM_TYPES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int64_t  s64;
+typedef uint8_t  __u8;
+typedef uint16_t __u16;
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+typedef int32_t  __s32;
+typedef int64_t  __s64;
+
+typedef struct { long counter; } atomic_t;
+typedef struct { long long counter; } atomic64_t;
+
+struct rcu_head { void *next; void (*func)(struct rcu_head *); };
+struct list_head { struct list_head *next, *prev; };
+
+#define __rcu
+#define __percpu
+
+#define U32_MAX ((u32)~0U)
+
+#endif /*KI_SHIM_TYPES_H*/
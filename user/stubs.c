@@ -0,0 +1,79 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+/*
+ * Kernel functions used by parser.c and validate.c in user space builds.
+ * Symbol and module lookups always succeed, except for names starting
+ * with KI_STUB_MISSING.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "stubs.h"
+#include "symcache.h"
+#include "segment.h"
+#include <linux/percpu.h>
+
+/* --- GLOBALS ------------------------------------------------------------- */
+__thread int ki_shim_cpu;
+
+static struct ki_segments ki_stub_segments;
+
+/* --- STUBS --------------------------------------------------------------- */
+/*
+ * Symbol address is derived from its name
+ */
+unsigned long ki_symcache_lookup(const char *name)
+{
+        unsigned long hash = 5381;
+
+        if (!strncmp(name, KI_STUB_MISSING, sizeof(KI_STUB_MISSING) - 1))
+                return 0;
+
+        while (*name) hash = hash * 33 + (unsigned char)*name++;
+        return 0xffffffff81000000UL | (hash & 0xffffff);
+}
+
+/*
+ * Every module shares one segment table
+ */
+struct ki_segments *ki_segments_get(const char *name)
+{
+        if (!strncmp(name, KI_STUB_MISSING, sizeof(KI_STUB_MISSING) - 1))
+                return NULL;
+
+        return &ki_stub_segments;
+}
+
+/*
+ * Same as ki_init_injection of injection.c, which is not built here
+ */
+void ki_init_injection(struct ki_injection *injection)
+{
+        memset(injection, 0, sizeof(*injection));
+}
+
+/*
+ * Free memory allocated by the parser
+ */
+void ki_stubs_free(struct ki_injection *injection)
+{
+        free(injection->target.name);
+        free(injection->trigger.name);
+        free(injection->module_name);
+        free(injection->replay);
+}
@@ -0,0 +1,30 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#ifndef KI_STUBS_H
+#define KI_STUBS_H
+
+#include "injection.h"
+
+/* --- DEFINES ------------------------------------------------------------- */
+#define KI_STUB_MISSING "missing" /* Prefix of names which are not found */
+
+/* --- STUB FUNCTIONS ------------------------------------------------------ */
+void ki_stubs_free(struct ki_injection *injection);
+
+#endif /*KI_STUBS_H*/
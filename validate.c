@@ -0,0 +1,338 @@
+/*-----------------------------------------------------------------------------
+    This file is part of Simple Linux Kernel Fault Injector.
+    Copyright (C) 2013  Przemysław Lenart <przemek.lenart@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see [http://www.gnu.org/licenses/].
+-----------------------------------------------------------------------------*/
+
+#include <linux/kernel.h>
+#include "injection.h"
+#include "records.h"
+#include "kinjector.h"
+#include "symcache.h"
+#include "segment.h"
+
+/*
+ * Validate REPLAY entries. Entries must fit their places, BITFLIP gives
+ * size of the target. Segments are checked again when entries are
+ * replayed, module may be loaded again with different segments, and
+ * registers when trigger is armed.
+ * Return true on success.
+ */
+static bool ki_validate_replay(struct ki_injection *injection, char **msg)
+{
+        unsigned int i;
+
+        if (!ki_is_triggered(injection)) {
+                *msg = "REPLAY requires TRIGGER or TRIGGER_TIMER";
+                return false;
+        }
+
+        if (injection->fault || injection->sched ||
+            injection->max_inj || injection->skipped_inj ||
+            (injection->flags & (KI_FLG_STACK | KI_FLG_REGS | 
+                                 KI_FLG_SEGMENTS))) {
+                *msg = "REPLAY doesn't allow FAULT, STACK, REGS, "
+                       "segments, limits or scheduling";
+                return false;
+        }
+
+        for (i = 0; i < injection->replay_count; ++i) {
+                const struct ki_replay *replay = &injection->replay[i];
+
+                switch (replay->type) {
+                case KI_REC_TARGET:
+                        if (!injection->target.addr) {
+                                *msg = "REPLAY TARGET requires INJECT_INTO";
+                                return false;
+                        }
+                        if (ki_replay_fits(replay, injection->bitflip))
+                                continue;
+                        *msg = "REPLAY TARGET offset out of BITFLIP bytes";
+                        return false;
+                case KI_REC_STACK:
+                case KI_REC_REGS:
+                        if (!injection->trigger.addr) {
+                                *msg = "REPLAY STACK, REGS require TRIGGER";
+                                return false;
+                        }
+                        if (replay->type == KI_REC_REGS ||
+                            ki_replay_fits(replay, KI_STACK_BYTES))
+                                continue;
+                        *msg = "REPLAY STACK offset out of stack bytes";
+                        return false;
+                default:
+                        if (injection->segments) continue;
+                        *msg = "REPLAY segments require MODULE";
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+/*
+ * Validate injection structure.
+ * Return true on success. Information about eventual failure is passed
+ * to msg variable.
+ */
+bool ki_validate_injection(struct ki_injection *injection, char **msg)
+{
+        /* Check clear flag first */
+        if (injection->flags & KI_FLG_CLEAR) return true;
+
+        /* Remove and show only need an id */
+        if (injection->flags & (KI_FLG_REMOVE | KI_FLG_SHOW)) {
+                if ((injection->flags & KI_FLG_REMOVE) &&
+                    (injection->flags & KI_FLG_SHOW)) {
+                        *msg = "REMOVE and SHOW are exclusive";
+                        return false;
+                }
+                if (injection->ref_id <= 0 || injection->ref_id > INT_MAX) {
+                        *msg = "REMOVE, SHOW require positive id";
+                        return false;
+                }
+                return true;
+        }
+
+        /* If we have a module get its segment table */
+        if (injection->module_name) {
+                injection->segments = ki_segments_get(injection->module_name);
+                if (!injection->segments) {
+                        *msg = "Module not found";
+                        return false;
+                }
+        }
+
+        /* If we have a target symbol, get it's address */
+        if (injection->target.name) {
+                injection->target.addr 
+                        = ki_symcache_lookup(injection->target.name);
+                if (!injection->target.addr) {
+                        *msg = "Injection symbol not found";
+                        return false;
+                }
+        }
+     
+        /* We cannot do direct injection without bitflip specified */
+        if (injection->target.addr) {
+                if (!injection->bitflip && !injection->replay_count) {
+                        *msg = "INJECT_INTO requires BITFLIP or REPLAY";
+                        return false;
+                }
+        }
+
+        /* If we have trigger symbol, get it's address */
+        if (injection->trigger.name) {
+                injection->trigger.addr 
+                        = ki_symcache_lookup(injection->trigger.name);
+                if (!injection->trigger.addr) {
+                        *msg = "Trigger symbol not found";
+                        return false;
+                }
+        }
+
+        /* BITFLIP requires target */
+        if (injection->bitflip && !injection->target.addr) {
+                *msg = "BITFLIP requires INJECT_INTO";
+                return false;
+        }
+
+        /* STACK | REGS require trigger */
+        if ((injection->flags & (KI_FLG_STACK | KI_FLG_REGS)) &&
+             !injection->trigger.addr) {
+                *msg = "CODE, REGS require TRIGGER";
+                return false;
+        }
+
+        /* Segments require MODULE */
+        if ((injection->flags & KI_FLG_SEGMENTS) && !injection->segments) {
+                *msg = "RODATA, DATA, CODE, BSS, INIT, PERCPU require MODULE";
+                return false;
+        }
+
+        /* Fault model require something to inject into */
+        if (injection->fault && !injection->target.addr &&
+            !(injection->flags & (KI_FLG_STACK | KI_FLG_REGS | 
+                                  KI_FLG_SEGMENTS))) {
+                *msg = "FAULT requires INJECT_INTO, STACK, REGS or MODULE "
+                       "segment";
+                return false;
+        }
+
+        /* Inject offset require injection target */
+        if (injection->target_offset && !injection->target.addr) {
+                *msg = "INJECT_OFFSET require INJECT_INTO";
+                return false;
+        }
+
+        /* Trigger offset require trigger */
+        if (injection->trigger_offset && !injection->trigger.addr) {
+                *msg = "TRIGGER_OFFSET require TRIGGER";
+                return false;
+        }
+
+        /* Trigger mode require trigger */
+        if (injection->trigger_mode && !injection->trigger.addr) {
+                *msg = "TRIGGER_MODE require TRIGGER";
+                return false;
+        }
+
+        /* Ftrace can be used only on function entry */
+        if (injection->trigger_mode == KI_TRIG_FTRACE &&
+            injection->trigger_offset) {
+                *msg = "TRIGGER_MODE FTRACE doesn't allow TRIGGER_OFFSET";
+                return false;
+        }
+
+        /* Outcome is captured by a return probe on function entry */
+        if ((injection->flags & KI_FLG_OUTCOME) && !injection->trigger.addr) {
+                *msg = "OUTCOME requires TRIGGER";
+                return false;
+        }
+        if ((injection->flags & KI_FLG_OUTCOME) &&
+            (injection->trigger_offset || 
+             injection->trigger_mode == KI_TRIG_FTRACE)) {
+                *msg = "OUTCOME doesn't allow TRIGGER_OFFSET, FTRACE";
+                return false;
+        }
+
+        /* Timer trigger checks */
+        if (injection->timer_period < 0 || injection->timer_jitter < 0) {
+                *msg = "TRIGGER_TIMER, TIMER_JITTER must be >= 0";
+                return false;
+        }
+        if (injection->timer_period && injection->trigger.addr) {
+                *msg = "TRIGGER and TRIGGER_TIMER are exclusive";
+                return false;
+        }
+        if ((injection->timer_jitter || 
+             (injection->flags & KI_FLG_TIMER_PERCPU)) &&
+            !injection->timer_period) {
+                *msg = "TIMER_JITTER, TIMER_PERCPU require TRIGGER_TIMER";
+                return false;
+        }
+        if (injection->timer_period && !injection->target.addr &&
+            !(injection->flags & KI_FLG_SEGMENTS) && 
+            !injection->replay_count) {
+                *msg = "TRIGGER_TIMER requires INJECT_INTO, MODULE segment "
+                       "or REPLAY";
+                return false;
+        }
+        if (injection->timer_period && 
+            injection->timer_period < KI_TIMER_MIN_PERIOD) {
+                *msg = "TRIGGER_TIMER must be at least 10000ns";
+                return false;
+        }
+        if (injection->timer_jitter > injection->timer_period) {
+                *msg = "TIMER_JITTER can't exceed TRIGGER_TIMER";
+                return false;
+        }
+
+        /* Max number of injections must be positive */
+        if (injection->max_inj < 0) {
+                *msg = "MAX_INJECTIONS must be >= 0";
+                return false;
+        }
+
+        /* If maximum number of injections is specified, trigger
+         * must exist.
+         */
+        if (injection->max_inj && !ki_is_triggered(injection)) {
+                *msg = "MAX_INJECTIONS require TRIGGER";
+                return false;
+        }
+
+        /* Number of skipped injections must be positive */
+        if (injection->skipped_inj < 0) {
+                *msg = "SKIPPED_INJECTIONS must be >= 0";
+                return false;
+        }
+
+        /* If a number of skipped injections is specified, trigger
+         * must exist.
+         */
+        if (injection->skipped_inj && !ki_is_triggered(injection)) {
+                *msg = "SKIPPED_INJECTIONS require TRIGGER";
+                return false;
+        }
+
+        /* Scheduling policy is applied to trigger hits */
+        if (injection->sched && !ki_is_triggered(injection)) {
+                *msg = "PROBABILITY, EVERY, POISSON require TRIGGER";
+                return false;
+        }
+
+        /* Campaign repeats immediate injection */
+        if (injection->campaign < 0) {
+                *msg = "CAMPAIGN must be >= 0";
+                return false;
+        }
+        if (injection->campaign && ki_is_triggered(injection)) {
+                *msg = "CAMPAIGN doesn't allow TRIGGER";
+                return false;
+        }
+        if (injection->campaign && !injection->target.addr &&
+            !(injection->flags & KI_FLG_SEGMENTS)) {
+                *msg = "CAMPAIGN requires INJECT_INTO or MODULE segment";
+                return false;
+        }
+        if ((injection->interval || injection->duration) && 
+            !injection->campaign) {
+                *msg = "INTERVAL, DURATION require CAMPAIGN";
+                return false;
+        }
+        if (injection->interval < 0 || injection->duration < 0) {
+                *msg = "INTERVAL, DURATION must be >= 0";
+                return false;
+        }
+
+        /* Profile samples module's text and injects nothing */
+        if (injection->profile < 0) {
+                *msg = "PROFILE must be >= 0";
+                return false;
+        }
+        if (injection->profile && !injection->segments) {
+                *msg = "PROFILE requires MODULE";
+                return false;
+        }
+        if (injection->profile && 
+            (ki_is_triggered(injection) || injection->campaign ||
+             injection->target.addr || 
+             (injection->flags & (KI_FLG_STACK | KI_FLG_REGS | 
+                                  KI_FLG_SEGMENTS)))) {
+                *msg = "PROFILE doesn't allow injection keywords";
+                return false;
+        }
+
+        /* Replay repeats recorded modifications at recorded hits */
+        if (injection->replay_count && !ki_validate_replay(injection, msg))
+                return false;
+
+        /* Check scheduling argument ranges */
+        if (injection->sched == KI_SCHED_PROBABILITY &&
+            (!injection->sched_arg || injection->sched_arg > (1ULL << 32))) {
+                *msg = "PROBABILITY must be in (0, 1] range";
+                return false;
+        }
+        if ((injection->sched == KI_SCHED_EVERY ||
+             injection->sched == KI_SCHED_POISSON) &&
+            (!injection->sched_arg || injection->sched_arg > INT_MAX)) {
+                *msg = "EVERY, POISSON must be in [1, 2^31) range";
+                return false;
+        }
+
+        return true;
+}
+